@@ -0,0 +1,146 @@
+#ifndef CONCURRENT_UTILS_HPP
+#define CONCURRENT_UTILS_HPP
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+namespace concurrent_utils
+{
+
+// bounded lock-free ring buffer, every cell carries a sequence number so that
+// producers and consumers only contend on a single atomic each (Vyukov queue)
+template<typename T>
+class ring_buffer
+{
+public:
+    explicit ring_buffer(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        cells_.reset(new cell[size]);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ring_buffer(const ring_buffer&) = delete;
+    ring_buffer& operator=(const ring_buffer&) = delete;
+
+    // value is only moved from when the push succeeds
+    bool try_push(T&& value)
+    {
+        std::size_t position = 0;
+        return try_push(std::move(value), position);
+    }
+
+    // position is the index of the value in pop order, counting every value ever pushed
+    bool try_push(T&& value, std::size_t& position)
+    {
+        cell* c = acquire_push_cell();
+        if (c == nullptr)
+            return false;
+        position = c->pos;
+        c->value = std::move(value);
+        c->seq.store(c->pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& value)
+    {
+        cell* c = acquire_push_cell();
+        if (c == nullptr)
+            return false;
+        c->value = value;
+        c->seq.store(c->pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value)
+    {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell& c = cells_[pos & mask_];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(c.value);
+                    c.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    // only a hint while producers or consumers are running
+    std::size_t size_approx() const
+    {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<std::size_t> seq;
+        std::size_t pos;
+        T value;
+    };
+
+    cell* acquire_push_cell()
+    {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell& c = cells_[pos & mask_];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    c.pos = pos;
+                    return &c;
+                }
+            }
+            else if (diff < 0)
+            {
+                return nullptr;
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::unique_ptr<cell[]> cells_;
+    std::size_t mask_ = 0;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+};
+
+}
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef JSON_UTILS_HPP
+#define JSON_UTILS_HPP
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace json_utils
+{
+
+class value
+{
+public:
+    enum class kind
+    {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+
+    kind type() const
+    {
+        return type_;
+    }
+
+    bool is_null() const
+    {
+        return type_ == kind::null;
+    }
+
+    bool as_bool(bool def = false) const
+    {
+        return type_ == kind::boolean ? boolean_ : def;
+    }
+
+    double as_number(double def = 0) const
+    {
+        return type_ == kind::number ? number_ : def;
+    }
+
+    const std::string& as_string() const
+    {
+        return string_;
+    }
+
+    const std::vector<value>& as_array() const
+    {
+        return array_;
+    }
+
+    const std::vector<std::pair<std::string, value>>& as_object() const
+    {
+        return object_;
+    }
+
+    bool contains(std::string_view key) const
+    {
+        for (auto& member : object_)
+        {
+            if (member.first == key)
+                return true;
+        }
+        return false;
+    }
+
+    // missing members and out of range elements yield a null value
+    const value& operator[](std::string_view key) const
+    {
+        for (auto& member : object_)
+        {
+            if (member.first == key)
+                return member.second;
+        }
+        return null_value();
+    }
+
+    const value& operator[](std::size_t i) const
+    {
+        return i < array_.size() ? array_[i] : null_value();
+    }
+
+    std::size_t size() const
+    {
+        return type_ == kind::array ? array_.size() : object_.size();
+    }
+
+private:
+    friend class parser;
+
+    static const value& null_value()
+    {
+        static const value null;
+        return null;
+    }
+
+    kind type_ = kind::null;
+    bool boolean_ = false;
+    double number_ = 0;
+    std::string string_;
+    std::vector<value> array_;
+    std::vector<std::pair<std::string, value>> object_;
+};
+
+class parser
+{
+public:
+    explicit parser(std::string_view text) : text_(text)
+    {
+
+    }
+
+    bool parse(value& out)
+    {
+        skip_space();
+        if (!parse_value(out, 0))
+            return false;
+        skip_space();
+        return pos_ == text_.size();
+    }
+
+private:
+    static constexpr int max_depth = 256;
+
+    void skip_space()
+    {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+            pos_++;
+    }
+
+    bool consume(std::string_view word)
+    {
+        if (text_.substr(pos_, word.size()) != word)
+            return false;
+        pos_ += word.size();
+        return true;
+    }
+
+    bool parse_value(value& out, int depth)
+    {
+        if (pos_ >= text_.size() || depth > max_depth)
+            return false;
+        switch (text_[pos_])
+        {
+        case '{':
+            return parse_object(out, depth);
+        case '[':
+            return parse_array(out, depth);
+        case '"':
+            out.type_ = value::kind::string;
+            return parse_string(out.string_);
+        case 't':
+            out.type_ = value::kind::boolean;
+            out.boolean_ = true;
+            return consume("true");
+        case 'f':
+            out.type_ = value::kind::boolean;
+            out.boolean_ = false;
+            return consume("false");
+        case 'n':
+            out.type_ = value::kind::null;
+            return consume("null");
+        default:
+            return parse_number(out);
+        }
+    }
+
+    bool parse_object(value& out, int depth)
+    {
+        out.type_ = value::kind::object;
+        pos_++;
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == '}')
+        {
+            pos_++;
+            return true;
+        }
+        while (true)
+        {
+            skip_space();
+            std::pair<std::string, value> member;
+            if (pos_ >= text_.size() || text_[pos_] != '"' || !parse_string(member.first))
+                return false;
+            skip_space();
+            if (!consume(":"))
+                return false;
+            skip_space();
+            if (!parse_value(member.second, depth + 1))
+                return false;
+            out.object_.push_back(std::move(member));
+            skip_space();
+            if (consume("}"))
+                return true;
+            if (!consume(","))
+                return false;
+        }
+    }
+
+    bool parse_array(value& out, int depth)
+    {
+        out.type_ = value::kind::array;
+        pos_++;
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == ']')
+        {
+            pos_++;
+            return true;
+        }
+        while (true)
+        {
+            skip_space();
+            value element;
+            if (!parse_value(element, depth + 1))
+                return false;
+            out.array_.push_back(std::move(element));
+            skip_space();
+            if (consume("]"))
+                return true;
+            if (!consume(","))
+                return false;
+        }
+    }
+
+    bool parse_number(value& out)
+    {
+        std::size_t start = pos_;
+        while (pos_ < text_.size() && (isdigit((unsigned char)text_[pos_]) || text_[pos_] == '-' || text_[pos_] == '+' ||
+                                       text_[pos_] == '.' || text_[pos_] == 'e' || text_[pos_] == 'E'))
+            pos_++;
+        if (start == pos_)
+            return false;
+        std::string number(text_.substr(start, pos_ - start));
+        char* end = nullptr;
+        out.type_ = value::kind::number;
+        out.number_ = strtod(number.data(), &end);
+        return end == number.data() + number.size();
+    }
+
+    static void append_utf8(std::string& out, unsigned code)
+    {
+        if (code < 0x80)
+        {
+            out += static_cast<char>(code);
+        }
+        else if (code < 0x800)
+        {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000)
+        {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+        else
+        {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool parse_hex4(unsigned& code)
+    {
+        if (pos_ + 4 > text_.size())
+            return false;
+        std::string hex(text_.substr(pos_, 4));
+        char* end = nullptr;
+        code = static_cast<unsigned>(strtoul(hex.data(), &end, 16));
+        pos_ += 4;
+        return end == hex.data() + 4;
+    }
+
+    bool parse_string(std::string& out)
+    {
+        pos_++;
+        while (pos_ < text_.size())
+        {
+            char c = text_[pos_++];
+            if (c == '"')
+                return true;
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size())
+                return false;
+            char escape = text_[pos_++];
+            switch (escape)
+            {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                unsigned code = 0;
+                if (!parse_hex4(code))
+                    return false;
+                if (code >= 0xd800 && code < 0xdc00 && consume("\\u"))
+                {
+                    unsigned low = 0;
+                    if (!parse_hex4(low))
+                        return false;
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default: out += escape; break;
+            }
+        }
+        return false;
+    }
+
+    std::string_view text_;
+    std::size_t pos_ = 0;
+};
+
+inline bool parse(std::string_view text, value& out)
+{
+    out = value();
+    return parser(text).parse(out);
+}
+
+}
+
+#endif
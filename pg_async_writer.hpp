@@ -0,0 +1,244 @@
+#ifndef PG_ASYNC_WRITER_HPP
+#define PG_ASYNC_WRITER_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "pg_ormlite.hpp"
+#include "concurrent_utils.hpp"
+
+namespace pg_ormlite
+{
+
+struct async_writer_options
+{
+    // rounded up to a power of two
+    std::size_t queue_capacity = 8192;
+    // rows per multi-row insert
+    std::size_t batch_size = 512;
+    // a partially filled batch is written at the latest after this interval
+    std::chrono::milliseconds flush_interval{100};
+};
+
+// write-behind inserter: producers push rows into a ring buffer and a dedicated
+// thread drains it into multi-row inserts on its own connection.
+// the connection must not be used by any other thread while the writer runs.
+template<typename T>
+class async_writer
+{
+public:
+    using error_callback = std::function<void(std::vector<T>&& batch, const std::string& error)>;
+
+    async_writer(pg_connection& conn, async_writer_options options = {}, error_callback on_error = nullptr)
+    : conn_(conn),
+      options_(options),
+      on_error_(std::move(on_error)),
+      queue_(options.queue_capacity)
+    {
+        if (options_.batch_size == 0)
+            options_.batch_size = 1;
+        worker_ = std::thread([this] { run(); });
+    }
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    ~async_writer()
+    {
+        stop();
+    }
+
+    // blocks while the queue is full, returns false once the writer is stopped
+    bool push(T&& t)
+    {
+        producer_scope scope(producers_);
+        while (!stopping_)
+        {
+            if (enqueue(t))
+                return true;
+            // sleeps until the writer has taken rows out of the queue
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_cv_.notify_one();
+            space_cv_.wait(lock, [this] {
+                return stopping_ || queue_.size_approx() < queue_.capacity();
+            });
+        }
+        return false;
+    }
+
+    // never blocks on a full queue, returns false when the queue is full or the writer is stopped
+    bool try_push(T&& t)
+    {
+        producer_scope scope(producers_);
+        return !stopping_ && enqueue(t);
+    }
+
+    // barrier: returns once every row pushed before the call has been written or reported as failed
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::size_t target = pushed_;
+        flush_target_ = std::max(flush_target_, target);
+        wake_cv_.notify_one();
+        done_cv_.wait(lock, [this, target] {
+            return written_ >= target || finished_;
+        });
+    }
+
+    // drains the queue, then joins the writer thread
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+                return;
+            stopping_ = true;
+            wake_cv_.notify_one();
+            space_cv_.notify_all();
+        }
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    std::size_t pending() const
+    {
+        return queue_.size_approx();
+    }
+
+private:
+    // a producer is counted from before it checks stopping_ until its push is over.
+    // stop() sets stopping_ before the writer reads the count, so once the writer sees
+    // stopping_ and no producer, every later push sees stopping_ and is refused.
+    struct producer_scope
+    {
+        explicit producer_scope(std::atomic<std::size_t>& count) : count_(count)
+        {
+            count_.fetch_add(1);
+        }
+
+        ~producer_scope()
+        {
+            count_.fetch_sub(1);
+        }
+
+        std::atomic<std::size_t>& count_;
+    };
+
+    // lock-free, the mutex is only taken to wake the writer once a batch is queued
+    bool enqueue(T& t)
+    {
+        std::size_t position = 0;
+        if (!queue_.try_push(std::move(t), position))
+            return false;
+        // rows are written in queue order, a flush waits for the last position handed out
+        std::size_t pushed = pushed_.load(std::memory_order_relaxed);
+        while (pushed < position + 1 && !pushed_.compare_exchange_weak(pushed, position + 1))
+        {
+        }
+        if ((position + 1) % options_.batch_size == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_cv_.notify_one();
+        }
+        return true;
+    }
+
+    void run()
+    {
+        std::vector<T> batch;
+        batch.reserve(options_.batch_size);
+        auto deadline = std::chrono::steady_clock::now() + options_.flush_interval;
+        while (true)
+        {
+            T item{};
+            std::size_t popped = 0;
+            while (batch.size() < options_.batch_size && queue_.try_pop(item))
+            {
+                batch.push_back(std::move(item));
+                popped++;
+            }
+
+            bool stopping = false;
+            bool flushing = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (popped > 0)
+                    space_cv_.notify_all();
+                stopping = stopping_;
+                flushing = written_ < flush_target_;
+                if (batch.empty() && stopping && producers_ == 0 && queue_.size_approx() == 0)
+                {
+                    finished_ = true;
+                    break;
+                }
+            }
+            bool urgent = flushing || stopping || std::chrono::steady_clock::now() >= deadline;
+            if (batch.size() >= options_.batch_size || (!batch.empty() && urgent))
+            {
+                write_batch(batch);
+                deadline = std::chrono::steady_clock::now() + options_.flush_interval;
+                continue;
+            }
+            // a producer that started before stop() is still finishing its push
+            if (stopping)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // the predicate is checked under the mutex and producers notify under it,
+            // a flush, stop or full batch between the checks above and the wait is not missed
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_cv_.wait_until(lock, deadline, [this] {
+                return stopping_ || written_ < flush_target_ || queue_.size_approx() >= options_.batch_size;
+            });
+            if (batch.empty())
+                deadline = std::chrono::steady_clock::now() + options_.flush_interval;
+        }
+        done_cv_.notify_all();
+    }
+
+    void write_batch(std::vector<T>& batch)
+    {
+        std::size_t count = batch.size();
+        if (conn_.bulk_insert(batch) == 0 && on_error_)
+        {
+            on_error_(std::move(batch), conn_.error_message());
+        }
+        batch.clear();
+        batch.reserve(options_.batch_size);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            written_ += count;
+        }
+        done_cv_.notify_all();
+    }
+
+    pg_connection& conn_;
+    async_writer_options options_;
+    error_callback on_error_;
+    concurrent_utils::ring_buffer<T> queue_;
+
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::size_t> producers_{0};
+    // one past the last queue position handed to a push
+    std::atomic<std::size_t> pushed_{0};
+
+    // guarded by mutex_
+    std::size_t flush_target_ = 0;
+    std::size_t written_ = 0;
+    bool finished_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable space_cv_;
+    std::condition_variable done_cv_;
+    std::thread worker_;
+};
+
+}
+
+#endif
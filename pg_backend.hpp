@@ -0,0 +1,316 @@
+#ifndef PG_BACKEND_HPP
+#define PG_BACKEND_HPP
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <libpq-fe.h>
+#include "pg_codec.hpp"
+#include "pg_cancel.hpp"
+
+namespace pg_ormlite
+{
+
+// parse a value in postgres text format into a reflected field
+template<typename T>
+constexpr void assign_text(T&& value, const char* ptr)
+{
+    using U = std::remove_const_t<std::remove_reference_t<T>>;
+    codec<U>::decode(value, ptr);
+}
+
+// named server side statements of one connection by their text and parameter types,
+// so that a statement prepared ahead of time runs by name instead of being parsed and
+// planned again. the types are part of the key because a prepared statement keeps them.
+class prepared_statements
+{
+public:
+    // the name a statement is prepared under, the same on every connection
+    static std::string name_for(const std::string& sql, const std::vector<Oid>& types)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "pg_ormlite_%016zx", std::hash<std::string>{}(key(sql, types)));
+        return buf;
+    }
+
+    // nullptr when the statement is not prepared on this connection
+    const std::string* find(const std::string& sql, const std::vector<Oid>& types) const
+    {
+        auto it = names_.find(key(sql, types));
+        return it == names_.end() ? nullptr : &it->second;
+    }
+
+    void add(const std::string& sql, const std::vector<Oid>& types, const std::string& name)
+    {
+        names_[key(sql, types)] = name;
+    }
+
+    // a new session knows none of them
+    void clear()
+    {
+        names_.clear();
+    }
+
+    std::size_t size() const
+    {
+        return names_.size();
+    }
+
+private:
+    static std::string key(const std::string& sql, const std::vector<Oid>& types)
+    {
+        std::string key = sql;
+        for (Oid type : types)
+        {
+            key += '\0' + std::to_string(type);
+        }
+        return key;
+    }
+
+    std::unordered_map<std::string, std::string> names_;
+};
+
+// a backend gives query_object a uniform way to run statements:
+//   connection_type                   native connection handle
+//   statement(conn, sql)              prepare, parameters are written $1..$n
+//   statement::bind(index, value)     typed bind of a reflected field, 1-based
+//   statement::bind_param(index, p)   bind a param_value encoded by the caller
+//   statement::prepared(name)         run a statement prepared under name instead of the text
+//   statement::step(options)          execute within a timeout and cancel token, return a cursor
+//   cursor::ok/error/affected/bytes   status, message, affected rows and result size
+//   cursor::next()                    fetch the next row
+//   cursor::get(col, value)           typed column access into a reflected field
+//   cursor::get_row(row, first)       columns first.. into a reflected struct in field order
+//   cursor::is_null(col)
+//   expand_arrays(sql, params)        the statement text to run, for backends without array parameters
+// a cursor must not outlive its statement.
+struct pg_backend
+{
+    using connection_type = PGconn;
+
+    class cursor
+    {
+    public:
+        explicit cursor(PGresult* res) : res_(res)
+        {
+            rows_ = PQresultStatus(res_) == PGRES_TUPLES_OK ? PQntuples(res_) : 0;
+        }
+
+        cursor(cursor&& other) noexcept : res_(other.res_), row_(other.row_), rows_(other.rows_)
+        {
+            other.res_ = nullptr;
+        }
+
+        cursor(const cursor&) = delete;
+        cursor& operator=(const cursor&) = delete;
+
+        ~cursor()
+        {
+            if (res_ != nullptr)
+                PQclear(res_);
+        }
+
+        bool ok() const
+        {
+            auto status = PQresultStatus(res_);
+            return status == PGRES_TUPLES_OK || status == PGRES_COMMAND_OK;
+        }
+
+        std::string error() const
+        {
+            return PQresultErrorMessage(res_);
+        }
+
+        long affected() const
+        {
+            return PQresultStatus(res_) == PGRES_TUPLES_OK ? rows_ : atol(PQcmdTuples(res_));
+        }
+
+        bool next()
+        {
+            return ++row_ < rows_;
+        }
+
+        int columns() const
+        {
+            return PQnfields(res_);
+        }
+
+        bool is_null(int col) const
+        {
+            return PQgetisnull(res_, row_, col);
+        }
+
+        template<typename U>
+        void get(int col, U&& value) const
+        {
+            using V = std::remove_const_t<std::remove_reference_t<U>>;
+            codec<V>::decode_column(value, column(col));
+        }
+
+        template<typename T>
+        void get_row(T& row, int first = 0) const
+        {
+            decode_row(row, [this, first](int col, Oid) {
+                return column(first + col);
+            });
+        }
+
+        // bytes received for the whole result
+        std::size_t bytes() const
+        {
+            std::size_t bytes = 0;
+            int nfields = PQnfields(res_);
+            for (int i = 0; i < rows_; i++)
+            {
+                for (int j = 0; j < nfields; j++)
+                {
+                    bytes += PQgetlength(res_, i, j);
+                }
+            }
+            return bytes;
+        }
+
+    private:
+        column_value column(int col) const
+        {
+            if (PQgetisnull(res_, row_, col))
+                return column_value{nullptr, 0, PQftype(res_, col), false};
+            return column_value{PQgetvalue(res_, row_, col), PQgetlength(res_, row_, col),
+                                PQftype(res_, col), PQfformat(res_, col) == 1};
+        }
+
+        PGresult* res_;
+        int row_ = -1;
+        int rows_ = 0;
+    };
+
+    class statement
+    {
+    public:
+        statement(PGconn* conn, std::string sql) : conn_(conn), sql_(std::move(sql))
+        {
+
+        }
+
+        template<typename U>
+        void bind(int index, U&& value)
+        {
+            using V = std::remove_const_t<std::remove_reference_t<U>>;
+            bind_param(index, value_param<V>(value));
+        }
+
+        // a parameter encoded by the caller, such as a binary array
+        void bind_param(int index, param_value param)
+        {
+            if (params_.size() < (std::size_t)index)
+                params_.resize(index);
+            params_[index - 1] = std::move(param);
+        }
+
+        // the server already holds the statement under name, with its parameter types
+        void prepared(const std::string& name)
+        {
+            name_ = name;
+        }
+
+        // results always come back in binary format. without limits PQgetResult blocks
+        // until the statement is done, with them the socket is polled first.
+        cursor step(const exec_options& options = {})
+        {
+            // a cancel request only reaches a statement the server is still running
+            if (options.token != nullptr && options.token->cancelled())
+            {
+                log_error("cancelled before it was sent:", sql_);
+                return cursor(PQmakeEmptyPGresult(conn_, PGRES_FATAL_ERROR));
+            }
+            param_buffers buffers(params_);
+            int sent = name_.empty() ?
+                PQsendQueryParams(conn_, sql_.data(), buffers.size(), buffers.types.data(), buffers.values.data(),
+                                  buffers.lengths.data(), buffers.formats.data(), 1) :
+                PQsendQueryPrepared(conn_, name_.data(), buffers.size(), buffers.values.data(),
+                                    buffers.lengths.data(), buffers.formats.data(), 1);
+            if (!sent)
+                return cursor(PQmakeEmptyPGresult(conn_, PGRES_FATAL_ERROR));
+            if (options.limited())
+                wait(options);
+            // the last result carries the status, a cancelled statement ends with an error
+            PGresult* last = nullptr;
+            while (PGresult* res = PQgetResult(conn_))
+            {
+                if (last != nullptr)
+                    PQclear(last);
+                last = res;
+            }
+            return cursor(last != nullptr ? last : PQmakeEmptyPGresult(conn_, PGRES_FATAL_ERROR));
+        }
+
+    private:
+        // waits for the result on the socket, past the deadline or on a cancelled
+        // token the server is asked to cancel the statement and the wait goes on
+        void wait(const exec_options& options)
+        {
+            PGcancel* cancel = PQgetCancel(conn_);
+            auto interrupt = [cancel]() {
+                char err[256];
+                if (cancel != nullptr && !PQcancel(cancel, err, sizeof(err)))
+                    log_error("cancel failed:", err);
+            };
+            if (options.token != nullptr)
+                options.token->attach(interrupt);
+            auto deadline = std::chrono::steady_clock::now() + options.timeout;
+            bool timed_out = false;
+            while (PQisBusy(conn_))
+            {
+                int wait_ms = -1;
+                if (options.timeout.count() > 0 && !timed_out)
+                {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                    if (remaining.count() <= 0)
+                    {
+                        log_error("statement timeout after ", options.timeout.count(), "ms:", sql_);
+                        interrupt();
+                        timed_out = true;
+                        continue;
+                    }
+                    wait_ms = (int)remaining.count() + 1;
+                }
+                pollfd pfd{PQsocket(conn_), POLLIN, 0};
+                int rc = poll(&pfd, 1, wait_ms);
+                if (rc < 0 && errno != EINTR)
+                    break;
+                if (rc > 0 && !PQconsumeInput(conn_))
+                    break;
+            }
+            if (options.token != nullptr)
+                options.token->detach();
+            PQfreeCancel(cancel);
+        }
+
+        PGconn* conn_;
+        std::string sql_;
+        std::string name_;
+        // a zero type is inferred by the server, lengths only matter for binary values
+        std::vector<param_value> params_;
+    };
+
+    // the server takes array parameters as they are
+    static const std::string& expand_arrays(const std::string& sql, std::vector<param_value>&)
+    {
+        return sql;
+    }
+
+    static std::string error_message(PGconn* conn)
+    {
+        return PQerrorMessage(conn);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef PG_BATCH_LOADER_HPP
+#define PG_BATCH_LOADER_HPP
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+struct batch_loader_options
+{
+    // distinct keys per query
+    std::size_t max_batch = 256;
+    // how long the first lookup of a batch waits for others to join it
+    std::chrono::microseconds window{500};
+};
+
+// coalesces point lookups by key from many threads: lookups that arrive within one
+// window become a single "where key = any($1)" query, a key asked for twice in a
+// window is fetched once. the connection must not be used by any other thread.
+template<typename T, typename Key>
+class batch_loader
+{
+public:
+    batch_loader(pg_connection& conn, const key_map& key, batch_loader_options options = {})
+    : conn_(conn),
+      key_(key.fields),
+      options_(options),
+      sql_("select * from " + std::string(reflection::get_name<T>()) + " where " + key.fields + " = any($1);")
+    {
+        if (options_.max_batch == 0)
+            options_.max_batch = 1;
+        worker_ = std::thread([this] { run(); });
+    }
+
+    batch_loader(const batch_loader&) = delete;
+    batch_loader& operator=(const batch_loader&) = delete;
+
+    ~batch_loader()
+    {
+        stop();
+    }
+
+    // the rows whose key equals key, empty when there are none or the query failed
+    std::future<std::vector<T>> load(const Key& key)
+    {
+        std::promise<std::vector<T>> promise;
+        auto future = promise.get_future();
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+            {
+                promise.set_value({});
+                return future;
+            }
+            if (pending_.empty())
+            {
+                deadline_ = std::chrono::steady_clock::now() + options_.window;
+                wake = true;
+            }
+            pending_[key].push_back(std::move(promise));
+            wake = wake || pending_.size() >= options_.max_batch;
+        }
+        if (wake)
+            cv_.notify_one();
+        return future;
+    }
+
+    // answers the lookups already made, then joins the loader thread
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+                return;
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+private:
+    using waiters = std::map<Key, std::vector<std::promise<std::vector<T>>>>;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty())
+                break;
+            cv_.wait_until(lock, deadline_, [this] { return stopping_ || pending_.size() >= options_.max_batch; });
+            waiters batch;
+            batch.swap(pending_);
+            lock.unlock();
+            while (!batch.empty())
+            {
+                // keys that piled up while the last batch ran go out max_batch at a time
+                waiters chunk;
+                while (!batch.empty() && chunk.size() < options_.max_batch)
+                {
+                    chunk.insert(batch.extract(batch.begin()));
+                }
+                dispatch(chunk);
+            }
+            lock.lock();
+        }
+    }
+
+    void dispatch(waiters& batch)
+    {
+        std::vector<Key> keys;
+        keys.reserve(batch.size());
+        for (auto& entry : batch)
+        {
+            keys.push_back(entry.first);
+        }
+        log_trace("batch load:", reflection::get_name<T>(), " keys=", keys.size());
+        auto start = slow_query_log::instance().start();
+        std::map<Key, std::vector<T>> found;
+        {
+            pg_backend::statement stmt(conn_.native_handle(), sql_);
+            auto keys_param = array_param(keys);
+            stmt.bind_param(1, keys_param);
+            auto cursor = stmt.step();
+            if (!cursor.ok())
+                log_error(cursor.error());
+            long rows = 0;
+            while (cursor.next())
+            {
+                T row = {};
+                cursor.get_row(row);
+                Key key{};
+                read_key(row, key);
+                found[key].push_back(std::move(row));
+                rows++;
+            }
+            if (start != std::chrono::steady_clock::time_point{})
+            {
+                param_buffers buffers({keys_param});
+                slow_query_log::instance().finish(start, reflection::get_name<T>(), sql_, rows, cursor.ok(), buffers.printable());
+            }
+        }
+        for (auto& entry : batch)
+        {
+            auto rows = found.find(entry.first);
+            for (auto& promise : entry.second)
+            {
+                promise.set_value(rows == found.end() ? std::vector<T>{} : rows->second);
+            }
+        }
+    }
+
+    void read_key(const T& row, Key& out) const
+    {
+        reflection::for_each(row, [&](auto item, auto field, auto j){
+            using U = std::remove_const_t<std::remove_reference_t<decltype(row.*item)>>;
+            if (field != key_)
+                return;
+            if constexpr (std::is_array_v<U> && std::is_same_v<Key, std::string>)
+                out = std::string(row.*item, strnlen(row.*item, sizeof(U)));
+            else if constexpr (std::is_assignable_v<Key&, const U&>)
+                out = row.*item;
+        });
+    }
+
+    pg_connection& conn_;
+    std::string key_;
+    batch_loader_options options_;
+    std::string sql_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    waiters pending_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PG_CANCEL_HPP
+#define PG_CANCEL_HPP
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+namespace pg_ormlite
+{
+
+// lets another thread abort the statements of a query. a triggered token stays
+// triggered, statements started with it afterwards are aborted at once until reset().
+class cancel_token
+{
+public:
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_.store(true, std::memory_order_release);
+        if (interrupt_)
+            interrupt_();
+    }
+
+    bool cancelled() const
+    {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    void reset()
+    {
+        cancelled_.store(false, std::memory_order_release);
+    }
+
+    // a backend registers how to interrupt the statement it is running
+    void attach(std::function<void()> interrupt)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupt_ = std::move(interrupt);
+        if (cancelled())
+            interrupt_();
+    }
+
+    void detach()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupt_ = nullptr;
+    }
+
+private:
+    std::mutex mutex_;
+    std::function<void()> interrupt_;
+    std::atomic<bool> cancelled_{false};
+};
+
+// limits for running one statement, a zero timeout waits forever
+struct exec_options
+{
+    std::chrono::milliseconds timeout{0};
+    cancel_token* token = nullptr;
+
+    bool limited() const
+    {
+        return timeout.count() > 0 || token != nullptr;
+    }
+};
+
+}
+
+#endif
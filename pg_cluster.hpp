@@ -0,0 +1,254 @@
+#ifndef PG_CLUSTER_HPP
+#define PG_CLUSTER_HPP
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pg_pool.hpp"
+
+namespace pg_ormlite
+{
+
+struct cluster_options
+{
+    // replicas further behind the primary are skipped, zero disables the check
+    std::chrono::milliseconds max_lag{0};
+    // how often a replica's lag is measured
+    std::chrono::milliseconds lag_check_interval{1000};
+    // a session reads from the primary for this long after its last write
+    std::chrono::milliseconds read_your_writes_window{1000};
+};
+
+class cluster_session;
+
+// one primary and any number of replicas, each behind its own pool.
+// reads go to the replica with the fewest outstanding leases, writes go to the primary.
+class cluster_connection
+{
+public:
+    cluster_connection(std::shared_ptr<connection_pool> primary, std::vector<std::shared_ptr<connection_pool>> replicas,
+                       cluster_options options = {})
+    : primary_(std::move(primary)), options_(options)
+    {
+        for (auto& pool : replicas)
+        {
+            replicas_.push_back(std::make_unique<replica>(std::move(pool)));
+        }
+    }
+
+    // a reader that sees its own writes
+    cluster_session session();
+
+    template<typename T>
+    auto query()
+    {
+        return query_on<T>(route_read());
+    }
+
+    template<typename T>
+    auto update()
+    {
+        auto lease = primary_->acquire();
+        return lease->update<T>().keep_alive(lease);
+    }
+
+    template<typename T>
+    auto del()
+    {
+        auto lease = primary_->acquire();
+        return lease->del<T>().keep_alive(lease);
+    }
+
+    template<typename T>
+    int insert(T&& t)
+    {
+        return primary_->acquire()->insert(std::forward<T>(t));
+    }
+
+    template<typename T>
+    int bulk_insert(const std::vector<T>& t)
+    {
+        return primary_->acquire()->bulk_insert(t);
+    }
+
+    bool execute(const std::string& sql)
+    {
+        return primary_->acquire()->execute(sql);
+    }
+
+    // the pool a read would use now
+    std::shared_ptr<connection_pool> route_read()
+    {
+        replica* best = nullptr;
+        std::size_t best_load = std::numeric_limits<std::size_t>::max();
+        std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < replicas_.size(); i++)
+        {
+            replica* candidate = replicas_[(start + i) % replicas_.size()].get();
+            if (!fresh(*candidate))
+                continue;
+            std::size_t load = candidate->pool->outstanding();
+            if (load < best_load)
+            {
+                best = candidate;
+                best_load = load;
+            }
+        }
+        return best != nullptr ? best->pool : primary_;
+    }
+
+    std::shared_ptr<connection_pool> primary() const
+    {
+        return primary_;
+    }
+
+    const cluster_options& options() const
+    {
+        return options_;
+    }
+
+private:
+    friend class cluster_session;
+
+    struct replica
+    {
+        explicit replica(std::shared_ptr<connection_pool> p) : pool(std::move(p))
+        {
+
+        }
+
+        std::shared_ptr<connection_pool> pool;
+        std::mutex check_mutex;
+        std::atomic<long long> lag_ms{0};
+        std::atomic<long long> next_check{0};
+    };
+
+    template<typename T>
+    auto query_on(std::shared_ptr<connection_pool> pool)
+    {
+        auto lease = pool->acquire();
+        return lease->query<T>().keep_alive(lease);
+    }
+
+    // the lag is measured by one caller at a time, the others use the last value
+    bool fresh(replica& r)
+    {
+        if (options_.max_lag.count() <= 0)
+            return true;
+        long long now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (now >= r.next_check.load(std::memory_order_acquire))
+        {
+            std::unique_lock<std::mutex> lock(r.check_mutex, std::try_to_lock);
+            if (lock.owns_lock() && now >= r.next_check.load(std::memory_order_acquire))
+            {
+                r.lag_ms.store(measure_lag(*r.pool), std::memory_order_relaxed);
+                r.next_check.store(now + options_.lag_check_interval.count(), std::memory_order_release);
+            }
+        }
+        return r.lag_ms.load(std::memory_order_relaxed) <= options_.max_lag.count();
+    }
+
+    // a replica that has replayed everything it received is current even when the
+    // primary has been idle; an unreachable replica counts as infinitely behind
+    static long long measure_lag(connection_pool& pool)
+    {
+        auto lease = pool.acquire();
+        pg_backend::statement stmt(lease->native_handle(),
+            "select coalesce(case when pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() then 0 "
+            "else extract(epoch from now() - pg_last_xact_replay_timestamp()) * 1000 end, 0)::bigint;");
+        auto cursor = stmt.step();
+        long long lag = std::numeric_limits<long long>::max();
+        if (cursor.ok() && cursor.next())
+            cursor.get(0, lag);
+        else
+            log_error("replica lag check failed:", cursor.error());
+        return lag;
+    }
+
+    std::shared_ptr<connection_pool> primary_;
+    std::vector<std::unique_ptr<replica>> replicas_;
+    cluster_options options_;
+    std::atomic<std::size_t> next_{0};
+};
+
+// reads go to the primary for read_your_writes_window after a write of this session
+// has succeeded, so a client never misses its own change on a lagging replica
+class cluster_session
+{
+public:
+    explicit cluster_session(cluster_connection& cluster) : cluster_(cluster)
+    {
+
+    }
+
+    template<typename T>
+    auto query()
+    {
+        auto last_write = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(last_write_->load()));
+        bool pinned = std::chrono::steady_clock::now() - last_write < cluster_.options_.read_your_writes_window;
+        return cluster_.query_on<T>(pinned ? cluster_.primary_ : cluster_.route_read());
+    }
+
+    // the window starts when execute() of the returned builder succeeds
+    template<typename T>
+    auto update()
+    {
+        return cluster_.update<T>().on_success([last_write = last_write_]() { wrote(*last_write); });
+    }
+
+    template<typename T>
+    auto del()
+    {
+        return cluster_.del<T>().on_success([last_write = last_write_]() { wrote(*last_write); });
+    }
+
+    template<typename T>
+    int insert(T&& t)
+    {
+        int rows = cluster_.insert(std::forward<T>(t));
+        if (rows > 0)
+            wrote(*last_write_);
+        return rows;
+    }
+
+    template<typename T>
+    int bulk_insert(const std::vector<T>& t)
+    {
+        int rows = cluster_.bulk_insert(t);
+        if (rows > 0)
+            wrote(*last_write_);
+        return rows;
+    }
+
+    bool execute(const std::string& sql)
+    {
+        bool ok = cluster_.execute(sql);
+        if (ok)
+            wrote(*last_write_);
+        return ok;
+    }
+
+private:
+    using stamp = std::atomic<std::chrono::steady_clock::rep>;
+
+    static void wrote(stamp& last_write)
+    {
+        last_write.store(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    cluster_connection& cluster_;
+    // shared with the builders of update() and del(), which may finish on another thread
+    std::shared_ptr<stamp> last_write_ = std::make_shared<stamp>(0);
+};
+
+inline cluster_session cluster_connection::session()
+{
+    return cluster_session(*this);
+}
+
+}
+
+#endif
@@ -0,0 +1,916 @@
+#ifndef PG_CODEC_HPP
+#define PG_CODEC_HPP
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <iostream>
+#include <optional>
+#include <ratio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libpq-fe.h>
+#include "reflection.hpp"
+#include "pg_jsonb.hpp"
+#include "pg_log.hpp"
+
+namespace pg_ormlite
+{
+
+template<typename U>
+struct is_optional : std::false_type {};
+
+template<typename U>
+struct is_optional<std::optional<U>> : std::true_type {};
+
+template<typename U>
+struct remove_optional
+{
+    using type = U;
+};
+
+template<typename U>
+struct remove_optional<std::optional<U>>
+{
+    using type = U;
+};
+
+template<typename U>
+using remove_optional_t = typename remove_optional<U>::type;
+
+// std::vector fields travel in binary format: bytes as bytea, anything else as an array
+template<typename U>
+struct is_vector : std::false_type {};
+
+template<typename E, typename A>
+struct is_vector<std::vector<E, A>> : std::true_type {};
+
+template<typename U>
+struct is_bytes : std::false_type {};
+
+template<>
+struct is_bytes<std::vector<uint8_t>> : std::true_type {};
+
+template<>
+struct is_bytes<std::vector<std::byte>> : std::true_type {};
+
+// one column of a result row, data is nullptr for a sql null
+struct column_value
+{
+    const char* data = nullptr;
+    int length = 0;
+    Oid type = 0;
+    bool binary = false;
+};
+
+inline void append_big_endian(std::vector<char>& out, std::uint64_t value, int bytes)
+{
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+    }
+}
+
+inline std::uint64_t read_big_endian(const char* data, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value = (value << 8) | static_cast<unsigned char>(data[i]);
+    }
+    return value;
+}
+
+// bool, int2, int4, oid and int8
+inline bool is_integer_type(Oid type)
+{
+    return type == 16 || type == 21 || type == 23 || type == 26 || type == 20;
+}
+
+// float4, float8 and numeric
+inline bool is_float_type(Oid type)
+{
+    return type == 700 || type == 701 || type == 1700;
+}
+
+inline long long integer_value(const column_value& column)
+{
+    switch (column.type)
+    {
+        case 16: return column.data[0] != 0;
+        case 21: return (int16_t)read_big_endian(column.data, 2);
+        case 23: return (int32_t)read_big_endian(column.data, 4);
+        case 26: return (uint32_t)read_big_endian(column.data, 4);
+        default: return (int64_t)read_big_endian(column.data, 8);
+    }
+}
+
+// numeric in binary form: digit count, weight of the first base 10000 digit, sign, scale
+inline std::string numeric_text(const char* data, int length)
+{
+    if (length < 8)
+        return "0";
+    int digits = (int16_t)read_big_endian(data, 2);
+    int weight = (int16_t)read_big_endian(data + 2, 2);
+    std::uint64_t sign = read_big_endian(data + 4, 2);
+    int scale = (int)read_big_endian(data + 6, 2);
+    if (sign == 0xC000)
+        return "NaN";
+    auto digit = [&](int i) {
+        return i >= 0 && i < digits && 8 + 2 * i + 2 <= length ? (int)read_big_endian(data + 8 + 2 * i, 2) : 0;
+    };
+    std::string text = sign == 0x4000 ? "-" : "";
+    if (weight < 0)
+        text += "0";
+    for (int i = 0; i <= weight; i++)
+    {
+        std::string group = std::to_string(digit(i));
+        text += i == 0 ? group : std::string(4 - group.size(), '0') + group;
+    }
+    if (scale > 0)
+    {
+        std::string fraction;
+        for (int i = weight + 1; (int)fraction.size() < scale; i++)
+        {
+            std::string group = std::to_string(digit(i));
+            fraction += std::string(4 - group.size(), '0') + group;
+        }
+        text += "." + fraction.substr(0, scale);
+    }
+    return text;
+}
+
+inline double binary_float(const column_value& column)
+{
+    if (column.type == 700)
+    {
+        std::uint32_t bits = (std::uint32_t)read_big_endian(column.data, 4);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    if (column.type == 701)
+    {
+        std::uint64_t bits = read_big_endian(column.data, 8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    if (column.type == 1700)
+        return strtod(numeric_text(column.data, column.length).data(), nullptr);
+    if (is_integer_type(column.type))
+        return (double)integer_value(column);
+    return strtod(std::string(column.data, column.length).data(), nullptr);
+}
+
+// a binary number column of any width, so that count(*) or sum() decode into any integer field
+inline long long binary_integer(const column_value& column)
+{
+    if (is_integer_type(column.type))
+        return integer_value(column);
+    if (column.type == 1700)
+        return strtoll(numeric_text(column.data, column.length).data(), nullptr, 10);
+    if (is_float_type(column.type))
+        return (long long)binary_float(column);
+    return strtoll(std::string(column.data, column.length).data(), nullptr, 10);
+}
+
+// numbers are formatted as the server would, other types arrive as their bytes
+inline std::string binary_text(const column_value& column)
+{
+    if (column.type == 16)
+        return column.data[0] != 0 ? "t" : "f";
+    if (is_integer_type(column.type))
+        return std::to_string(integer_value(column));
+    if (column.type == 1700)
+        return numeric_text(column.data, column.length);
+    if (is_float_type(column.type))
+    {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), column.type == 700 ? "%.9g" : "%.17g", binary_float(column));
+        return std::string(buf, n);
+    }
+    // binary jsonb is a version byte and the text
+    if (column.type == 3802 && column.length > 0 && column.data[0] == 1)
+        return std::string(column.data + 1, column.length - 1);
+    return std::string(column.data, column.length);
+}
+
+// system_clock time points: a whole day resolution is a date, anything finer a timestamptz
+template<typename U>
+struct is_time_point : std::false_type {};
+
+template<typename D>
+struct is_time_point<std::chrono::time_point<std::chrono::system_clock, D>> : std::true_type {};
+
+template<typename U>
+constexpr bool is_date()
+{
+    if constexpr (is_time_point<U>::value)
+        return std::ratio_equal_v<typename U::period, std::ratio<86400>>;
+    else
+        return false;
+}
+
+#if __cplusplus >= 202002L
+using std::chrono::sys_days;
+#else
+using sys_days = std::chrono::time_point<std::chrono::system_clock, std::chrono::duration<int, std::ratio<86400>>>;
+#endif
+
+// postgres counts dates in days and timestamps in microseconds from 2000-01-01
+constexpr long long pg_epoch_days = 10957;
+constexpr long long pg_epoch_micros = pg_epoch_days * 86400 * 1000000LL;
+
+// days since 1970-01-01 of a proleptic gregorian date
+constexpr long long days_from_civil(long long y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long long)doe - 719468;
+}
+
+// the value postgres stores: days for a date, microseconds for a timestamp. the largest
+// and smallest time points are stored as infinity and -infinity, as from_time_count reads them.
+template<typename U>
+long long time_count(const U& value)
+{
+    if (value == U::max())
+        return is_date<U>() ? INT32_MAX : INT64_MAX;
+    if (value == U::min())
+        return is_date<U>() ? (long long)INT32_MIN : INT64_MIN;
+    if constexpr (is_date<U>())
+        return (long long)value.time_since_epoch().count() - pg_epoch_days;
+    else
+        return std::chrono::floor<std::chrono::microseconds>(value.time_since_epoch()).count() - pg_epoch_micros;
+}
+
+// count is in days when date is set, infinity becomes the largest or smallest time point
+template<typename U>
+U from_time_count(long long count, bool date)
+{
+    long long infinity = date ? INT32_MAX : INT64_MAX;
+    if (count == infinity)
+        return U::max();
+    if (count == (date ? (long long)INT32_MIN : INT64_MIN))
+        return U::min();
+    using micro_point = std::chrono::time_point<std::chrono::system_clock, std::chrono::microseconds>;
+    if constexpr (is_date<U>())
+    {
+        long long days = date ? count : (count >= 0 ? count / 86400000000LL : -((-count + 86399999999LL) / 86400000000LL));
+        return U(typename U::duration(days + pg_epoch_days));
+    }
+    else
+    {
+        long long micros = date ? count * 86400000000LL : count;
+        return std::chrono::time_point_cast<typename U::duration>(micro_point(std::chrono::microseconds(micros + pg_epoch_micros)));
+    }
+}
+
+// text form of a date or timestamp, 2024-03-01 12:30:05.25+01, as notifications carry it
+template<typename U>
+U parse_time(const char* text)
+{
+    if (strcmp(text, "infinity") == 0)
+        return U::max();
+    if (strcmp(text, "-infinity") == 0)
+        return U::min();
+    long long year = 0;
+    unsigned month = 1, day = 1, hour = 0, minute = 0, second = 0;
+    int read = 0;
+    sscanf(text, "%lld-%u-%u%n", &year, &month, &day, &read);
+    const char* p = text + read;
+    if (*p == ' ' || *p == 'T')
+    {
+        read = 0;
+        sscanf(p + 1, "%u:%u:%u%n", &hour, &minute, &second, &read);
+        p += 1 + read;
+    }
+    long long micros = 0;
+    if (*p == '.')
+    {
+        long long scale = 100000;
+        for (p++; *p >= '0' && *p <= '9'; p++, scale /= 10)
+        {
+            micros += (*p - '0') * scale;
+        }
+    }
+    long long offset = 0;
+    if (*p == '+' || *p == '-')
+    {
+        unsigned zone_hour = 0, zone_minute = 0;
+        sscanf(p + 1, "%2u:%2u", &zone_hour, &zone_minute);
+        if (zone_minute == 0 && strlen(p + 1) == 4)
+            sscanf(p + 1, "%2u%2u", &zone_hour, &zone_minute);
+        offset = (*p == '-' ? -1 : 1) * (long long)(zone_hour * 3600 + zone_minute * 60);
+    }
+    long long seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+    return from_time_count<U>(seconds * 1000000 + micros - pg_epoch_micros, false);
+}
+
+template<typename U>
+struct binary_element;
+
+template<typename Container>
+void append_binary_array(const Container& values, std::vector<char>& out);
+
+// postgres wire format and parameter type oid of one field type. scalars are sent
+// as text and bytea and arrays in binary, every type is read back from binary results.
+// the type dispatch is resolved once per field type at compile time.
+template<typename U>
+struct codec
+{
+    static constexpr Oid oid()
+    {
+        if constexpr (is_optional<U>::value)
+            return codec<remove_optional_t<U>>::oid();
+        else if constexpr (is_time_point<U>::value)
+            return is_date<U>() ? 1082 : 1184;
+        else if constexpr (std::is_same_v<U, jsonb>)
+            return 3802;
+        else if constexpr (is_bytes<U>::value)
+            return 17;
+        else if constexpr (is_vector<U>::value)
+            return binary_element<typename U::value_type>::array_oid();
+        else if constexpr (std::is_same_v<U, int8_t> || std::is_same_v<U, uint8_t> ||
+                           std::is_same_v<U, int16_t> || std::is_same_v<U, uint16_t>)
+            return 21;
+        else if constexpr (std::is_same_v<U, int64_t> || std::is_same_v<U, uint64_t>)
+            return 20;
+        // bool and enums are stored in integer columns
+        else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>)
+            return 23;
+        else if constexpr (std::is_same_v<U, float>)
+            return 700;
+        else if constexpr (std::is_floating_point_v<U>)
+            return 701;
+        else if constexpr (std::is_same_v<U, std::string>)
+            return 25;
+        else if constexpr (std::is_array_v<U>)
+            return 1043;
+        else
+            return 0;
+    }
+
+    // parameter format, 0 text and 1 binary
+    static constexpr int format()
+    {
+        if constexpr (is_optional<U>::value)
+            return codec<remove_optional_t<U>>::format();
+        else
+            return is_vector<U>::value || is_time_point<U>::value || std::is_same_v<U, jsonb> ? 1 : 0;
+    }
+
+    // appends a nul terminated text value, or the binary value of bytea and arrays.
+    // returns false for a sql null.
+    static bool encode(const U& value, std::vector<char>& out)
+    {
+        if constexpr (is_optional<U>::value)
+        {
+            return value.has_value() && codec<remove_optional_t<U>>::encode(*value, out);
+        }
+        else if constexpr (is_time_point<U>::value)
+        {
+            append_big_endian(out, static_cast<std::uint64_t>(time_count(value)), is_date<U>() ? 4 : 8);
+        }
+        else if constexpr (std::is_same_v<U, jsonb>)
+        {
+            // version 1 of the binary format, the text follows. an empty document is a json null
+            out.push_back(1);
+            if (value.empty())
+                out.insert(out.end(), {'n', 'u', 'l', 'l'});
+            else
+                out.insert(out.end(), value.text().begin(), value.text().end());
+        }
+        else if constexpr (is_bytes<U>::value)
+        {
+            auto bytes = reinterpret_cast<const char*>(value.data());
+            out.insert(out.end(), bytes, bytes + value.size());
+        }
+        else if constexpr (is_vector<U>::value)
+        {
+            append_binary_array(value, out);
+        }
+        else if constexpr (std::is_enum_v<U>)
+        {
+            append(out, std::to_string(static_cast<std::underlying_type_t<U>>(value)));
+        }
+        else if constexpr (std::is_integral_v<U>)
+        {
+            append(out, std::to_string(value));
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            // shortest text that reads back to the same value
+            char buf[32];
+            int n = snprintf(buf, sizeof(buf), std::is_same_v<U, float> ? "%.9g" : "%.17g", (double)value);
+            append(out, std::string_view(buf, n));
+        }
+        else if constexpr (std::is_same_v<U, std::string>)
+        {
+            append(out, value);
+        }
+        else if constexpr (std::is_array_v<U>)
+        {
+            append(out, std::string_view(value, strnlen(value, sizeof(U))));
+        }
+        else
+        {
+            log_error("unsupported type:", std::is_array<U>::value);
+            return false;
+        }
+        return true;
+    }
+
+    // text is nullptr for a sql null, which leaves an empty value
+    static void decode(U& value, const char* text)
+    {
+        if constexpr (is_optional<U>::value)
+        {
+            if (text == nullptr)
+            {
+                value.reset();
+                return;
+            }
+            codec<remove_optional_t<U>>::decode(value.emplace(), text);
+        }
+        else if constexpr (is_time_point<U>::value)
+        {
+            value = text == nullptr ? U{} : parse_time<U>(text);
+        }
+        else if constexpr (std::is_same_v<U, jsonb>)
+        {
+            value = std::string(text == nullptr ? "" : text);
+        }
+        else if constexpr (is_bytes<U>::value)
+        {
+            // hex output, \x0a1b
+            value.clear();
+            if (text == nullptr || text[0] != '\\' || text[1] != 'x')
+                return;
+            for (const char* p = text + 2; p[0] != '\0' && p[1] != '\0'; p += 2)
+            {
+                char pair[3] = {p[0], p[1], '\0'};
+                value.push_back(static_cast<typename U::value_type>(strtoul(pair, nullptr, 16)));
+            }
+        }
+        else if constexpr (is_vector<U>::value)
+        {
+            // {1,2,NULL}, elements of the numeric arrays are never quoted
+            value.clear();
+            if (text == nullptr)
+                return;
+            std::string element;
+            for (const char* p = text; *p != '\0'; p++)
+            {
+                if (*p == '{')
+                    continue;
+                if (*p != ',' && *p != '}')
+                {
+                    element += *p;
+                    continue;
+                }
+                if (element.empty())
+                    continue;
+                typename U::value_type item{};
+                codec<typename U::value_type>::decode(item, element == "NULL" ? nullptr : element.data());
+                value.push_back(item);
+                element.clear();
+            }
+        }
+        else if constexpr (std::is_array_v<U>)
+        {
+            if (text == nullptr)
+                memset(value, 0, sizeof(U));
+            else
+                strncpy(value, text, sizeof(U));
+        }
+        else if constexpr (std::is_same_v<U, bool>)
+        {
+            value = text != nullptr && (text[0] == 't' || atoi(text) != 0);
+        }
+        else if constexpr (std::is_enum_v<U>)
+        {
+            value = static_cast<U>(text == nullptr ? 0 : atoi(text));
+        }
+        else if constexpr (std::is_same_v<U, int64_t>)
+        {
+            value = text == nullptr ? 0 : strtoll(text, nullptr, 10);
+        }
+        else if constexpr (std::is_same_v<U, uint64_t>)
+        {
+            value = text == nullptr ? 0 : strtoull(text, nullptr, 10);
+        }
+        else if constexpr (std::is_integral_v<U>)
+        {
+            value = text == nullptr ? 0 : atoi(text);
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            value = text == nullptr ? 0 : atof(text);
+        }
+        else if constexpr (std::is_same_v<U, std::string>)
+        {
+            value = text == nullptr ? "" : text;
+        }
+        else
+        {
+            log_error("unsupported type:", std::is_array<U>::value);
+        }
+    }
+
+    // a result column in either format, binary numbers convert to the field type
+    static void decode_column(U& value, const column_value& column)
+    {
+        if (column.data == nullptr || !column.binary)
+        {
+            decode(value, column.data);
+            return;
+        }
+        if constexpr (is_optional<U>::value)
+        {
+            codec<remove_optional_t<U>>::decode_column(value.emplace(), column);
+        }
+        else if constexpr (is_time_point<U>::value)
+        {
+            if (column.type == 1082)
+                value = from_time_count<U>((int32_t)read_big_endian(column.data, 4), true);
+            else if (column.type == 1184 || column.type == 1114)
+                value = from_time_count<U>((int64_t)read_big_endian(column.data, 8), false);
+            else
+                value = parse_time<U>(binary_text(column).data());
+        }
+        else if constexpr (std::is_same_v<U, jsonb>)
+        {
+            value = binary_text(column);
+        }
+        else if constexpr (is_bytes<U>::value)
+        {
+            auto bytes = reinterpret_cast<const typename U::value_type*>(column.data);
+            value.assign(bytes, bytes + column.length);
+        }
+        else if constexpr (is_vector<U>::value)
+        {
+            decode_array(value, column);
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            value = static_cast<U>(binary_float(column));
+        }
+        else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>)
+        {
+            value = static_cast<U>(binary_integer(column));
+        }
+        else if constexpr (std::is_same_v<U, std::string>)
+        {
+            value = binary_text(column);
+        }
+        else if constexpr (std::is_array_v<U>)
+        {
+            std::string text = binary_text(column);
+            memset(value, 0, sizeof(U));
+            memcpy(value, text.data(), std::min(text.size(), sizeof(U)));
+        }
+        else
+        {
+            log_error("unsupported type:", std::is_array<U>::value);
+        }
+    }
+
+private:
+    static void append(std::vector<char>& out, std::string_view text)
+    {
+        out.insert(out.end(), text.begin(), text.end());
+        out.push_back('\0');
+    }
+
+    // dimensions, flags and element type, then a length and the bytes of every element.
+    // arrays of more than one dimension are flattened, decoding stops at the end of the column.
+    template<typename V>
+    static void decode_array(V& value, const column_value& column)
+    {
+        using E = typename V::value_type;
+        value.clear();
+        if (column.length < 12)
+            return;
+        const char* end = column.data + column.length;
+        int dimensions = (int32_t)read_big_endian(column.data, 4);
+        Oid element_type = (Oid)read_big_endian(column.data + 8, 4);
+        const char* p = column.data + 12;
+        if (dimensions < 0 || dimensions > (end - p) / 8)
+            return;
+        std::size_t count = dimensions == 0 ? 0 : 1;
+        for (int d = 0; d < dimensions; d++, p += 8)
+        {
+            count *= (std::size_t)read_big_endian(p, 4);
+        }
+        value.reserve(std::min<std::size_t>(count, (end - p) / 4));
+        for (std::size_t i = 0; i < count && end - p >= 4; i++)
+        {
+            int length = (int32_t)read_big_endian(p, 4);
+            p += 4;
+            if (length > end - p)
+                break;
+            E item{};
+            codec<E>::decode_column(item, column_value{length < 0 ? nullptr : p, length < 0 ? 0 : length, element_type, true});
+            value.push_back(item);
+            if (length > 0)
+                p += length;
+        }
+    }
+};
+
+// one reflected field: where it lives in the struct and how it crosses the wire
+struct field_codec
+{
+    std::string_view name;
+    std::size_t offset;
+    std::size_t size;
+    Oid oid;
+    int format;
+    bool (*encode)(const char* field, std::vector<char>& out);
+    void (*decode)(char* field, const column_value& column);
+};
+
+// fields of packed structs may be unaligned, trivially copyable values are copied out first
+template<typename U>
+bool encode_field(const char* field, std::vector<char>& out)
+{
+    if constexpr (std::is_trivially_copyable_v<U>)
+    {
+        U value;
+        memcpy(&value, field, sizeof(U));
+        return codec<U>::encode(value, out);
+    }
+    else
+    {
+        return codec<U>::encode(*reinterpret_cast<const U*>(field), out);
+    }
+}
+
+template<typename U>
+void decode_field(char* field, const column_value& column)
+{
+    if constexpr (std::is_trivially_copyable_v<U>)
+    {
+        U value{};
+        codec<U>::decode_column(value, column);
+        memcpy(field, &value, sizeof(U));
+    }
+    else
+    {
+        codec<U>::decode_column(*reinterpret_cast<U*>(field), column);
+    }
+}
+
+template<typename T, typename U>
+field_codec make_field_codec(const T& probe, U T::* member, std::string_view name)
+{
+    std::size_t offset = reinterpret_cast<const char*>(&(probe.*member)) - reinterpret_cast<const char*>(&probe);
+    return field_codec{name, offset, sizeof(U), codec<U>::oid(), codec<U>::format(),
+                       &encode_field<U>, &decode_field<U>};
+}
+
+template<typename T, std::size_t... Idx>
+std::array<field_codec, sizeof...(Idx)> make_codec_table(std::index_sequence<Idx...>)
+{
+    constexpr auto members = reflection::Reflect_members<T>::apply_impl();
+    T probe{};
+    return {make_field_codec(probe, std::get<Idx>(members), reflection::get_name<T, Idx>())...};
+}
+
+// built once per reflected type and shared by inserts, parameter binding and row decoding
+template<typename T>
+const std::array<field_codec, reflection::get_value<T>()>& codec_table()
+{
+    static const auto table = make_codec_table<T>(std::make_index_sequence<reflection::get_value<T>()>{});
+    return table;
+}
+
+// a statement parameter that is encoded already, in text or in postgres binary format
+struct param_value
+{
+    std::vector<char> data;
+    Oid type = 0;
+    // 0 text, 1 binary
+    int format = 0;
+    bool null = false;
+};
+
+// one value as a parameter, text values leave their type to the server and
+// binary ones must name it
+template<typename U>
+param_value value_param(const U& value)
+{
+    param_value param;
+    param.format = codec<U>::format();
+    param.type = param.format == 0 ? 0 : codec<U>::oid();
+    param.null = !codec<U>::encode(value, param.data);
+    return param;
+}
+
+// one parameter per field
+template<typename T>
+void encode_row(const T& row, std::vector<param_value>& params)
+{
+    const char* base = reinterpret_cast<const char*>(&row);
+    for (auto& field : codec_table<T>())
+    {
+        param_value param;
+        param.type = field.oid;
+        param.format = field.format;
+        param.null = !field.encode(base + field.offset, param.data);
+        params.push_back(std::move(param));
+    }
+}
+
+// column_at(col, oid) returns the column_value of the row for a field sent as oid
+template<typename T, typename F>
+void decode_row(T& row, F&& column_at)
+{
+    char* base = reinterpret_cast<char*>(&row);
+    int col = 0;
+    for (auto& field : codec_table<T>())
+    {
+        field.decode(base + field.offset, column_at(col++, field.oid));
+    }
+}
+
+template<typename T>
+void append_param_types(std::vector<Oid>& types)
+{
+    for (auto& field : codec_table<T>())
+    {
+        types.push_back(field.oid);
+    }
+}
+
+// the array type of an element type, 0 when there is none
+constexpr Oid array_type(Oid element)
+{
+    switch (element)
+    {
+        case 21: return 1005;
+        case 23: return 1007;
+        case 20: return 1016;
+        case 700: return 1021;
+        case 701: return 1022;
+        case 25: return 1009;
+        case 1043: return 1015;
+        case 1082: return 1182;
+        case 1184: return 1185;
+        default: return 0;
+    }
+}
+
+// binary send format of one array element, integers take the postgres type of their width
+template<typename U>
+struct binary_element
+{
+    static constexpr Oid oid()
+    {
+        if constexpr (std::is_integral_v<U> || std::is_enum_v<U>)
+            return sizeof(U) <= 2 ? 21 : (sizeof(U) == 4 ? 23 : 20);
+        else
+            return codec<U>::oid();
+    }
+
+    static constexpr Oid array_oid()
+    {
+        return array_type(oid());
+    }
+
+    static void encode(const U& value, std::vector<char>& out)
+    {
+        if constexpr (std::is_enum_v<U>)
+            binary_element<std::underlying_type_t<U>>::encode(static_cast<std::underlying_type_t<U>>(value), out);
+        else if constexpr (std::is_integral_v<U>)
+            append_big_endian(out, static_cast<std::uint64_t>(static_cast<std::int64_t>(value)), sizeof(U) <= 2 ? 2 : (int)sizeof(U));
+        else if constexpr (std::is_same_v<U, float>)
+        {
+            std::uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            append_big_endian(out, bits, 4);
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            std::uint64_t bits;
+            double wide = value;
+            memcpy(&bits, &wide, sizeof(bits));
+            append_big_endian(out, bits, 8);
+        }
+        else if constexpr (std::is_same_v<U, std::string>)
+            out.insert(out.end(), value.begin(), value.end());
+        else if constexpr (std::is_array_v<U>)
+            out.insert(out.end(), value, value + strnlen(value, sizeof(U)));
+        else if constexpr (is_time_point<U>::value)
+            codec<U>::encode(value, out);
+        else
+            static_assert(std::is_array_v<U>, "unsupported array element type");
+    }
+};
+
+// a one dimensional array in binary format, optional elements may be null
+template<typename Container>
+void append_binary_array(const Container& values, std::vector<char>& out)
+{
+    using E = remove_optional_t<std::decay_t<decltype(*std::begin(values))>>;
+    std::size_t count = std::distance(std::begin(values), std::end(values));
+    append_big_endian(out, count == 0 ? 0 : 1, 4);
+    std::size_t has_null = out.size();
+    append_big_endian(out, 0, 4);
+    append_big_endian(out, binary_element<E>::oid(), 4);
+    if (count > 0)
+    {
+        append_big_endian(out, count, 4);
+        append_big_endian(out, 1, 4);
+    }
+    std::vector<char> element;
+    for (auto& value : values)
+    {
+        const E* present = nullptr;
+        if constexpr (is_optional<std::decay_t<decltype(value)>>::value)
+            present = value.has_value() ? &*value : nullptr;
+        else
+            present = &value;
+        if (present == nullptr)
+        {
+            out[has_null + 3] = 1;
+            append_big_endian(out, 0xffffffffu, 4);
+            continue;
+        }
+        element.clear();
+        binary_element<E>::encode(*present, element);
+        append_big_endian(out, element.size(), 4);
+        out.insert(out.end(), element.begin(), element.end());
+    }
+}
+
+// a container as one binary array parameter, so that "= any($1)" keeps the same
+// statement text and plan for any number of values
+template<typename Container>
+param_value array_param(const Container& values)
+{
+    using E = remove_optional_t<std::decay_t<decltype(*std::begin(values))>>;
+    param_value param;
+    param.type = binary_element<E>::array_oid();
+    param.format = 1;
+    append_binary_array(values, param.data);
+    return param;
+}
+
+// values, lengths, formats and types in the layout libpq takes them
+class param_buffers
+{
+public:
+    explicit param_buffers(const std::vector<param_value>& params)
+    {
+        for (auto& param : params)
+        {
+            // an empty non null value still needs a pointer, nullptr is a null
+            values.push_back(param.null ? nullptr : (param.data.empty() ? "" : param.data.data()));
+            lengths.push_back((int)param.data.size());
+            formats.push_back(param.format);
+            types.push_back(param.type);
+            labels_.push_back(param.format == 0 ? std::string() : "<" + std::to_string(param.data.size()) + " binary bytes>");
+        }
+    }
+
+    int size() const
+    {
+        return (int)values.size();
+    }
+
+    // parameters as text for logs, binary values show only their size
+    std::vector<const char*> printable() const
+    {
+        std::vector<const char*> texts;
+        for (std::size_t i = 0; i < values.size(); i++)
+        {
+            texts.push_back(values[i] == nullptr || formats[i] == 0 ? values[i] : labels_[i].data());
+        }
+        return texts;
+    }
+
+    std::vector<const char*> values;
+    std::vector<int> lengths;
+    std::vector<int> formats;
+    std::vector<Oid> types;
+
+private:
+    std::vector<std::string> labels_;
+};
+
+}
+
+#endif
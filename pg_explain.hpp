@@ -0,0 +1,105 @@
+#ifndef PG_EXPLAIN_HPP
+#define PG_EXPLAIN_HPP
+#include <functional>
+#include <string>
+#include <vector>
+#include "json_utils.hpp"
+
+namespace pg_ormlite
+{
+
+// one node of an explain (format json) plan, actual_* and *_blocks are only set by analyze/buffers
+struct plan_node
+{
+    std::string node_type;
+    std::string relation_name;
+    std::string index_name;
+    double startup_cost = 0;
+    double total_cost = 0;
+    double plan_rows = 0;
+    double actual_rows = 0;
+    double actual_loops = 0;
+    double actual_total_time = 0;
+    double shared_hit_blocks = 0;
+    double shared_read_blocks = 0;
+    std::vector<plan_node> children;
+};
+
+struct query_plan
+{
+    plan_node root;
+    double planning_time = 0;
+    double execution_time = 0;
+
+    bool valid() const
+    {
+        return !root.node_type.empty();
+    }
+
+    // depth first over every node of the plan
+    void visit(const std::function<void(const plan_node&)>& f) const
+    {
+        std::vector<const plan_node*> stack = {&root};
+        while (!stack.empty())
+        {
+            const plan_node* node = stack.back();
+            stack.pop_back();
+            f(*node);
+            for (auto& child : node->children)
+            {
+                stack.push_back(&child);
+            }
+        }
+    }
+
+    bool has_node(const std::string& node_type) const
+    {
+        bool found = false;
+        visit([&](const plan_node& node) { found = found || node.node_type == node_type; });
+        return found;
+    }
+
+    bool has_seq_scan() const
+    {
+        return has_node("Seq Scan");
+    }
+};
+
+inline plan_node parse_plan_node(const json_utils::value& json)
+{
+    plan_node node;
+    node.node_type = json["Node Type"].as_string();
+    node.relation_name = json["Relation Name"].as_string();
+    node.index_name = json["Index Name"].as_string();
+    node.startup_cost = json["Startup Cost"].as_number();
+    node.total_cost = json["Total Cost"].as_number();
+    node.plan_rows = json["Plan Rows"].as_number();
+    node.actual_rows = json["Actual Rows"].as_number();
+    node.actual_loops = json["Actual Loops"].as_number();
+    node.actual_total_time = json["Actual Total Time"].as_number();
+    node.shared_hit_blocks = json["Shared Hit Blocks"].as_number();
+    node.shared_read_blocks = json["Shared Read Blocks"].as_number();
+    for (auto& child : json["Plans"].as_array())
+    {
+        node.children.push_back(parse_plan_node(child));
+    }
+    return node;
+}
+
+// text of the single row returned by explain (format json)
+inline query_plan parse_plan(const char* text)
+{
+    query_plan plan;
+    json_utils::value json;
+    if (text == nullptr || !json_utils::parse(text, json))
+        return plan;
+    const json_utils::value& top = json[std::size_t(0)];
+    plan.root = parse_plan_node(top["Plan"]);
+    plan.planning_time = top["Planning Time"].as_number();
+    plan.execution_time = top["Execution Time"].as_number();
+    return plan;
+}
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef PG_JSONB_HPP
+#define PG_JSONB_HPP
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "json_utils.hpp"
+
+namespace pg_ormlite
+{
+
+// a json document field stored as jsonb. rows keep the text as it came from the server,
+// it is parsed only when a member is read, and at most once per fetched document.
+// copies share the document and its parsed tree, and may be read from several threads.
+class jsonb
+{
+public:
+    jsonb() = default;
+
+    explicit jsonb(std::string text) : document_(std::make_shared<document>(std::move(text)))
+    {
+
+    }
+
+    jsonb& operator=(std::string text)
+    {
+        document_ = std::make_shared<document>(std::move(text));
+        return *this;
+    }
+
+    const std::string& text() const
+    {
+        static const std::string none;
+        return document_ == nullptr ? none : document_->text;
+    }
+
+    bool empty() const
+    {
+        return text().empty();
+    }
+
+    // whether the text is a well formed document
+    bool valid() const
+    {
+        parse();
+        return document_ != nullptr && document_->ok;
+    }
+
+    const json_utils::value& value() const
+    {
+        return parse();
+    }
+
+    // missing members read as a null value
+    const json_utils::value& operator[](std::string_view key) const
+    {
+        return parse()[key];
+    }
+
+    const json_utils::value& operator[](std::size_t i) const
+    {
+        return parse()[i];
+    }
+
+    bool operator==(const jsonb& other) const
+    {
+        return text() == other.text();
+    }
+
+    bool operator!=(const jsonb& other) const
+    {
+        return text() != other.text();
+    }
+
+private:
+    // the text never changes once a document is made, assigning makes a new one
+    struct document
+    {
+        explicit document(std::string t) : text(std::move(t))
+        {
+
+        }
+
+        std::string text;
+        std::once_flag parsed;
+        json_utils::value value;
+        bool ok = false;
+    };
+
+    const json_utils::value& parse() const
+    {
+        static const json_utils::value null;
+        if (document_ == nullptr)
+            return null;
+        document& doc = *document_;
+        std::call_once(doc.parsed, [&doc]() {
+            doc.ok = json_utils::parse(doc.text, doc.value);
+            if (!doc.ok)
+                doc.value = json_utils::value();
+        });
+        return doc.value;
+    }
+
+    std::shared_ptr<document> document_;
+};
+
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef PG_LOCAL_TABLE_HPP
+#define PG_LOCAL_TABLE_HPP
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+template<typename T, auto Field, std::size_t... Idx>
+constexpr std::size_t member_index(std::index_sequence<Idx...>)
+{
+    using M = reflection::Reflect_members<T>;
+    constexpr auto members = M::apply_impl();
+    std::size_t index = sizeof...(Idx);
+    auto match = [&index](auto member, std::size_t i) {
+        if constexpr (std::is_same_v<decltype(member), decltype(Field)>)
+        {
+            if (member == Field && index == sizeof...(Idx))
+                index = i;
+        }
+    };
+    (match(std::get<Idx>(members), Idx), ...);
+    return index;
+}
+
+// index of a member pointer in the reflected field list of T
+template<typename T, auto Field>
+constexpr std::size_t member_index()
+{
+    return member_index<T, Field>(std::make_index_sequence<reflection::get_value<T>()>{});
+}
+
+// in-memory replica of a reflected table. rows live in one contiguous vector with an
+// open-addressing hash index on KeyField and an optional sorted index on SortField.
+// readers work on an immutable snapshot, writers build a new one and swap it in,
+// so lookups never wait for a refresh. the swap uses the atomic shared_ptr functions,
+// which libstdc++ implements with a small pool of mutexes: a read briefly locks one of
+// them to copy the pointer, it is not lock-free. every upsert, erase or applied change
+// copies the rows and rebuilds both indexes, O(n) per call, so pass changes to upsert
+// in batches rather than one row at a time on large tables. writers, including apply()
+// on a subscription thread, take turns on a mutex so none of them loses another's change.
+template<typename T, auto KeyField, auto SortField = nullptr>
+class local_table
+{
+    using key_type = typename pg_query_object::field_attribute<decltype(KeyField)>::return_type;
+
+    template<typename U>
+    using view_type = std::conditional_t<std::is_array_v<U>, std::string_view, U>;
+
+    template<typename U>
+    static view_type<U> field_view(const U& value)
+    {
+        if constexpr (std::is_array_v<U>)
+            return std::string_view(value, strnlen(value, sizeof(U)));
+        else
+            return value;
+    }
+
+public:
+    using lookup_type = view_type<key_type>;
+
+    class snapshot
+    {
+    public:
+        const T* find(const lookup_type& key) const
+        {
+            if (slots_.empty())
+                return nullptr;
+            for (std::size_t pos = hash(key) & mask_; slots_[pos] != 0; pos = (pos + 1) & mask_)
+            {
+                const T& row = rows_[slots_[pos] - 1];
+                if (field_view(row.*KeyField) == key)
+                    return &row;
+            }
+            return nullptr;
+        }
+
+        // rows with lo <= SortField <= hi in SortField order
+        template<typename V>
+        std::vector<T> range(const V& lo, const V& hi) const
+        {
+            static_assert(!std::is_same_v<decltype(SortField), std::nullptr_t>, "local_table has no sorted index");
+            auto less = [this](uint32_t idx, const V& value) { return field_view(rows_[idx].*SortField) < value; };
+            auto greater = [this](const V& value, uint32_t idx) { return value < field_view(rows_[idx].*SortField); };
+            auto first = std::lower_bound(sorted_.begin(), sorted_.end(), lo, less);
+            auto last = std::upper_bound(first, sorted_.end(), hi, greater);
+            std::vector<T> ret_vector;
+            ret_vector.reserve(last - first);
+            for (auto it = first; it != last; ++it)
+            {
+                ret_vector.push_back(rows_[*it]);
+            }
+            return ret_vector;
+        }
+
+        const std::vector<T>& rows() const
+        {
+            return rows_;
+        }
+
+    private:
+        friend class local_table;
+
+        static std::size_t hash(const lookup_type& key)
+        {
+            std::size_t h;
+            if constexpr (std::is_enum_v<lookup_type>)
+                h = static_cast<std::size_t>(key);
+            else
+                h = std::hash<lookup_type>{}(key);
+            // std::hash is the identity for integers, mix the bits before masking
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        void build()
+        {
+            std::size_t capacity = 16;
+            while (capacity < rows_.size() * 2)
+                capacity <<= 1;
+            mask_ = capacity - 1;
+            slots_.assign(capacity, 0);
+            for (std::size_t i = 0; i < rows_.size(); i++)
+            {
+                std::size_t pos = hash(field_view(rows_[i].*KeyField)) & mask_;
+                while (slots_[pos] != 0)
+                {
+                    pos = (pos + 1) & mask_;
+                }
+                slots_[pos] = static_cast<uint32_t>(i + 1);
+            }
+
+            if constexpr (!std::is_same_v<decltype(SortField), std::nullptr_t>)
+            {
+                sorted_.resize(rows_.size());
+                for (std::size_t i = 0; i < rows_.size(); i++)
+                {
+                    sorted_[i] = static_cast<uint32_t>(i);
+                }
+                std::stable_sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) {
+                    return field_view(rows_[a].*SortField) < field_view(rows_[b].*SortField);
+                });
+            }
+        }
+
+        std::vector<T> rows_;
+        std::vector<uint32_t> slots_;
+        std::vector<uint32_t> sorted_;
+        std::size_t mask_ = 0;
+    };
+
+    // the connection is only used by load, refresh and apply, which take turns on it.
+    // no other thread may use it while the table is loaded from it.
+    explicit local_table(pg_connection& conn) : conn_(conn), snapshot_(std::make_shared<const snapshot>())
+    {
+
+    }
+
+    bool load()
+    {
+        auto next = std::make_shared<snapshot>();
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            auto query = conn_.query<T>();
+            next->rows_ = query.to_vector();
+            if (!query.ok())
+                return false;
+        }
+        next->build();
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        std::atomic_store(&snapshot_, std::shared_ptr<const snapshot>(std::move(next)));
+        return true;
+    }
+
+    // reload the rows matching changed, e.g. FD(t::updated_at) > last_refresh, and upsert them
+    bool refresh(const pg_query_object::expr& changed)
+    {
+        std::vector<T> rows;
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            auto query = conn_.query<T>();
+            rows = query.where(changed).to_vector();
+            if (!query.ok())
+                return false;
+        }
+        return upsert(rows);
+    }
+
+    // keeps the replica fresh from a subscription on the same table
+    bool apply(const change_event<T>& event)
+    {
+        if (event.op == change_op::resync)
+            return load();
+        if (event.op == change_op::del)
+            return erase(field_view(event.row.*KeyField));
+
+        constexpr auto index = member_index<T, KeyField>();
+        std::string name(reflection::get_name<T, index>());
+        std::vector<T> rows;
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            auto query = conn_.query<T>();
+            rows = query.where(key_expr(name, event.row.*KeyField)).to_vector();
+            if (!query.ok())
+                return false;
+        }
+        if (rows.empty())
+            return erase(field_view(event.row.*KeyField));
+        return upsert(rows);
+    }
+
+    bool upsert(const std::vector<T>& rows)
+    {
+        if (rows.empty())
+            return true;
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        auto current = std::atomic_load(&snapshot_);
+        auto next = std::make_shared<snapshot>();
+        next->rows_ = current->rows_;
+        next->mask_ = current->mask_;
+        next->slots_ = current->slots_;
+        // the copied index only knows the old rows, a key repeated in the batch
+        // is found here and the last row for it wins
+        std::unordered_map<lookup_type, std::size_t> appended;
+        for (auto& row : rows)
+        {
+            auto key = field_view(row.*KeyField);
+            const T* found = next->find(key);
+            if (found != nullptr)
+            {
+                next->rows_[found - next->rows_.data()] = row;
+                continue;
+            }
+            auto added = appended.emplace(key, next->rows_.size());
+            if (added.second)
+                next->rows_.push_back(row);
+            else
+                next->rows_[added.first->second] = row;
+        }
+        next->build();
+        std::atomic_store(&snapshot_, std::shared_ptr<const snapshot>(std::move(next)));
+        return true;
+    }
+
+    bool erase(const lookup_type& key)
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        auto current = std::atomic_load(&snapshot_);
+        const T* found = current->find(key);
+        if (found == nullptr)
+            return false;
+        auto next = std::make_shared<snapshot>();
+        next->rows_.reserve(current->rows_.size() - 1);
+        for (auto& row : current->rows_)
+        {
+            if (&row != found)
+                next->rows_.push_back(row);
+        }
+        next->build();
+        std::atomic_store(&snapshot_, std::shared_ptr<const snapshot>(std::move(next)));
+        return true;
+    }
+
+    std::optional<T> get(const lookup_type& key) const
+    {
+        auto current = std::atomic_load(&snapshot_);
+        const T* found = current->find(key);
+        if (found == nullptr)
+            return std::nullopt;
+        return *found;
+    }
+
+    template<typename V>
+    std::vector<T> range(const V& lo, const V& hi) const
+    {
+        return std::atomic_load(&snapshot_)->range(lo, hi);
+    }
+
+    // pin the current snapshot to run several lookups without copying rows
+    std::shared_ptr<const snapshot> current() const
+    {
+        return std::atomic_load(&snapshot_);
+    }
+
+    std::size_t size() const
+    {
+        return std::atomic_load(&snapshot_)->rows_.size();
+    }
+
+private:
+    template<typename U>
+    static pg_query_object::expr key_expr(const std::string& name, const U& value)
+    {
+        pg_query_object::expr field(name, reflection::get_name<T>());
+        if constexpr (std::is_array_v<U>)
+            return field == std::string(field_view(value));
+        else
+            return field == value;
+    }
+
+    pg_connection& conn_;
+    std::shared_ptr<const snapshot> snapshot_;
+    // held from reading the current snapshot to storing the next one
+    std::mutex write_mutex_;
+    std::mutex conn_mutex_;
+};
+
+}
+
+#endif
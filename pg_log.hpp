@@ -0,0 +1,63 @@
+#ifndef PG_LOG_HPP
+#define PG_LOG_HPP
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace pg_ormlite
+{
+
+enum class log_level
+{
+    // statements as they are sent and progress of batches, prepares and scans
+    trace,
+    // failed statements, connections and files
+    error,
+};
+
+using log_handler = std::function<void(log_level level, const std::string& message)>;
+
+inline log_handler& log_sink()
+{
+    static log_handler handler;
+    return handler;
+}
+
+// where the library reports what it does. without a handler trace messages are dropped
+// and errors go to std::cerr. set it before any connection is in use.
+inline void set_log_handler(log_handler handler)
+{
+    log_sink() = std::move(handler);
+}
+
+// the parts are streamed into one message, only when it is going to be read
+template<typename... Args>
+void log_message(log_level level, const Args&... parts)
+{
+    const log_handler& handler = log_sink();
+    if (!handler && level == log_level::trace)
+        return;
+    std::ostringstream os;
+    (os << ... << parts);
+    if (handler)
+        handler(level, os.str());
+    else
+        std::cerr << os.str() << std::endl;
+}
+
+template<typename... Args>
+void log_trace(const Args&... parts)
+{
+    log_message(log_level::trace, parts...);
+}
+
+template<typename... Args>
+void log_error(const Args&... parts)
+{
+    log_message(log_level::error, parts...);
+}
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "reflection.hpp"
 #include "traits_utils.hpp"
 #include "pg_query_object.hpp"
+#include "pg_subscription.hpp"
 
 namespace pg_ormlite
 {
@@ -25,20 +26,121 @@ struct not_null_map
     std::set<std::string> fields;
 };
 
-template<typename... Args>
-constexpr auto sort_tuple(const std::tuple<Args...>& t)
+// secondary index, fields and include are comma separated column lists
+struct index_def
+{
+    std::string fields;
+    // btree, hash, brin, gin or gist
+    std::string method = "btree";
+    // predicate of a partial index
+    std::string where;
+    std::string include;
+    bool unique = false;
+};
+
+struct index_map
 {
-    if constexpr (sizeof...(Args) == 2)
+    std::vector<index_def> indexes;
+};
+
+// table_fields_method_idx. a partial or covering index adds a hash of its predicate and
+// include list, so that two of them on the same fields do not share a name and skip each
+// other in "create index if not exists". the name fits the 63 bytes postgres keeps.
+inline std::string index_name(std::string_view table, const index_def& index)
+{
+    std::string name = std::string(table) + "_" + index.fields + "_" + index.method;
+    name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+    std::replace(name.begin(), name.end(), ',', '_');
+    std::string suffix = "_idx";
+    if (!index.where.empty() || !index.include.empty())
     {
-        auto [a, b] = t;
-        if constexpr (!std::is_same_v<decltype(a), key_map> && !std::is_same_v<decltype(a), auto_key_map>)
+        // fnv-1a, the same name on every build
+        uint32_t hash = 2166136261u;
+        for (char c : index.where + '\0' + index.include)
         {
-            return std::make_tuple(b, a);
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
         }
+        char buf[16];
+        snprintf(buf, sizeof(buf), "_%08x", hash);
+        suffix = buf + suffix;
     }
-    return t;
+    name.resize(std::min(name.size(), 63 - suffix.size()));
+    return name + suffix;
+}
+
+enum class partition_type
+{
+    range,
+    list,
+    hash,
+};
+
+// a primary key of a partitioned table has to contain the partition fields
+struct partition_map
+{
+    partition_type type;
+    std::string fields;
+};
+
+struct storage_map
+{
+    // skips the wal, the table is truncated after a crash
+    bool unlogged = false;
+    // 0 keeps the server default, partitioned tables do not accept it
+    int fillfactor = 0;
+};
+
+template<typename T>
+constexpr auto key_option(const T& t)
+{
+    if constexpr (std::is_same_v<T, key_map> || std::is_same_v<T, auto_key_map>)
+        return std::make_tuple(t);
+    else
+        return std::tuple<>{};
 }
 
+template<typename T>
+constexpr auto not_null_option(const T& t)
+{
+    if constexpr (std::is_same_v<T, not_null_map>)
+        return std::make_tuple(t);
+    else
+        return std::tuple<>{};
+}
+
+// column options with the primary key first, table options are handled separately
+template<typename... Args>
+constexpr auto sort_tuple(const std::tuple<Args...>& t)
+{
+    return std::apply([](const auto&... args) {
+        return std::tuple_cat(key_option(args)..., not_null_option(args)...);
+    }, t);
+}
+
+// a notification of the change trigger, "INSERT:42", as the operation and the key field
+// of the row at key_index. false when the payload is not one.
+template<typename T>
+bool parse_change(const char* payload, std::size_t key_index, change_event<T>& event)
+{
+    const char* sep = strchr(payload, ':');
+    if (sep == nullptr)
+        return false;
+    std::string_view op(payload, sep - payload);
+    if (op == "INSERT")
+        event.op = change_op::insert;
+    else if (op == "UPDATE")
+        event.op = change_op::update;
+    else if (op == "DELETE")
+        event.op = change_op::del;
+    else
+        return false;
+    reflection::for_each(event.row, [&](auto item, auto field, auto j){
+        if (decltype(j)::value == key_index)
+            assign_text(event.row.*item, sep + 1);
+    });
+    return true;
+}
 
 class pg_connection
 {
@@ -76,36 +178,59 @@ public:
             sql = generate_connect_sql(fields, args_tp, index);
         }
         
-        std::cout<<"connect:"<<sql<<std::endl;
+        log_trace("connect:", sql);
+        conninfo_ = sql;
         conn_ = PQconnectdb(sql.data());
         if (PQstatus(conn_) != CONNECTION_OK)
         {
-            std::cout<< PQerrorMessage(conn_) <<std::endl;
+            log_error(PQerrorMessage(conn_));
         }
     }
 
+    // the unnamed statement unless a name is given, a named one is remembered for the session
     template<typename T>
-    bool prepare(const std::string& sql)
+    bool prepare(const std::string& sql, const std::string& name = "")
     {
-        res_ = PQprepare(conn_, "", sql.data(), (int)reflection::get_value<T>(), nullptr);
+        using U = std::remove_const_t<std::remove_reference_t<T>>;
+        std::vector<Oid> param_types;
+        append_param_types<U>(param_types);
+        res_ = PQprepare(conn_, name.data(), sql.data(), (int)param_types.size(), param_types.data());
         if (PQresultStatus(res_) != PGRES_COMMAND_OK)
         {
-            std::cout<< PQerrorMessage(conn_) <<std::endl;
+            log_error(PQerrorMessage(conn_));
+            PQclear(res_);
             return false;
         }
         PQclear(res_);
+        if (!name.empty())
+            prepared_.add(sql, param_types, name);
         return true;
     }
 
+    // the named statement of sql, prepared on first use, nullptr when preparing failed
+    template<typename T>
+    const std::string* prepared_name(const std::string& sql)
+    {
+        using U = std::remove_const_t<std::remove_reference_t<T>>;
+        std::vector<Oid> param_types;
+        append_param_types<U>(param_types);
+        if (auto name = prepared_.find(sql, param_types))
+            return name;
+        log_trace("prepare:", sql);
+        if (!prepare<T>(sql, prepared_statements::name_for(sql, param_types)))
+            return nullptr;
+        return prepared_.find(sql, param_types);
+    }
+
     template<typename T, typename... Args>
     bool create_table(Args&&... args)
     {
         std::string sql = generate_create_table_sql<T>(std::forward<Args>(args)...);
-        std::cout<<"create:"<<sql<<std::endl;
+        log_trace("create:", sql);
         res_ = PQexec(conn_, sql.data());
         if (PQresultStatus(res_) != PGRES_COMMAND_OK)
         {
-            std::cout<< PQerrorMessage(conn_) <<std::endl;
+            log_error(PQerrorMessage(conn_));
             return false;
         }
         PQclear(res_);
@@ -113,99 +238,66 @@ public:
     }
 
     template<typename T>
-    constexpr auto generate_insert_sql(bool replace)
+    constexpr auto generate_insert_sql(bool replace, size_t rows = 1)
     {
         std::string sql = replace ? "replace into " : "insert into ";
         std::string table_name = reflection::get_name<T>().data();
         std::string field_name_pack = reflection::get_field<T>().data();
-        sql += table_name + "(" + field_name_pack + ") values(";
+        sql += table_name + "(" + field_name_pack + ") values";
         constexpr auto field_size = reflection::get_value<T>();
-        for (size_t i = 0; i < field_size; i++)
+        for (size_t r = 0; r < rows; r++)
         {
-            sql += "$";
-            sql += std::to_string(i + 1);
-            if (i != field_size - 1)
+            sql += r == 0 ? "(" : ", (";
+            for (size_t i = 0; i < field_size; i++)
             {
-                sql += ", ";
+                sql += "$";
+                sql += std::to_string(r * field_size + i + 1);
+                if (i != field_size - 1)
+                {
+                    sql += ", ";
+                }
             }
+            sql += ")";
         }
-        sql += ");";
+        sql += ";";
         return sql;
     }
 
     template<typename T>
-    constexpr void set_param_values(std::vector<std::vector<char>>& param_values, T&& value)
+    bool insert_impl(const std::string& name, const std::string& sql, T&& t)
     {
-        using U = std::remove_const_t<std::remove_reference_t<T>>;
-        if constexpr(std::is_same_v<U, int64_t> || std::is_same_v<U, uint64_t>)  
-        { 
-            std::vector<char> temp(65, 0);
-            auto v_str = std::to_string(value);
-            memcpy(temp.data(), v_str.data(), v_str.size());
-            param_values.push_back(temp); 
-        }
-        else if constexpr(std::is_integral_v<U> || std::is_floating_point_v<U>)
-        {
-            std::vector<char> temp(20, 0);
-            auto v_str = std::to_string(value);
-            memcpy(temp.data(), v_str.data(), v_str.size());
-            param_values.push_back(std::move(temp)); 
-        }
-        else if constexpr(std::is_enum_v<U>)
-        {
-            std::vector<char> temp(20, 0);
-            auto v_str = std::to_string(static_cast<std::underlying_type_t<U>>(value));
-            memcpy(temp.data(), v_str.data(), v_str.size());
-            param_values.push_back(std::move(temp)); 
-        }
-        else if constexpr(std::is_same_v<U, std::string>)
-        {
-            std::vector<char> temp = {};
-            std::copy(value.data(), value.data() + value.size() + 1, std::back_inserter(temp));
-            param_values.push_back(std::move(temp)); 
-        }
-        else if constexpr(std::is_array<U>::value)
-        {
-            std::vector<char> temp = {};
-            std::copy(value, value + traits_utils::array_size<U>::value, std::back_inserter(temp));
-            param_values.push_back(std::move(temp));
-        }
-    }
-
-    template<typename T>
-    bool insert_impl(std::string& sql, T&& t)
-    {
-        std::vector<std::vector<char>> param_values;
-        reflection::for_each(t, [&](auto& item, auto field, auto j){
-            set_param_values(param_values, t.*item);
-        });
+        std::vector<param_value> param_values;
+        encode_row(t, param_values);
         if (param_values.empty())
         {
             return false;
         }
-        std::vector<const char *> param_values_buf;
-        for (auto &item : param_values) 
-        {
-            param_values_buf.push_back(item.data());
-        }
+        param_buffers buffers(param_values);
+        auto printable = buffers.printable();
 
-        std::cout<<"params:";
-        for (size_t i = 0; i < param_values_buf.size(); i++)
+        if (log_sink())
         {
-            std::cout << i << "="<<*(param_values_buf.data() + i)<<", ";
+            std::string line = "params:";
+            for (size_t i = 0; i < printable.size(); i++)
+            {
+                line += std::to_string(i) + "=" + (printable[i] == nullptr ? "null" : printable[i]) + ", ";
+            }
+            log_trace(line);
         }
-        std::cout<<std::endl;
-        res_ = PQexecPrepared(conn_, "", (int)param_values.size(),
-                            param_values_buf.data(), NULL, NULL, 0);
+        auto start = slow_query_log::instance().start();
+        res_ = PQexecPrepared(conn_, name.data(), buffers.size(),
+                            buffers.values.data(), buffers.lengths.data(), buffers.formats.data(), 0);
+        record_statement<T>(start, sql, printable);
 
         if (PQresultStatus(res_) != PGRES_COMMAND_OK) 
         {
-            std::cout << PQresultErrorMessage(res_) << std::endl;
+            log_error(PQresultErrorMessage(res_));
             PQclear(res_);
             return false;
         }
 
         PQclear(res_);
+        invalidate_cache<T>();
         return true;
     }
 
@@ -213,23 +305,23 @@ public:
     int insert(T&& t)
     {
         std::string sql = generate_insert_sql<T>(false);
-        std::cout<<"insert prepare:"<<sql<<std::endl;
-        if (!prepare<T>(sql))
+        auto name = prepared_name<T>(sql);
+        if (name == nullptr)
             return false;
-        return insert_impl(sql, std::forward<T>(t));
+        return insert_impl(*name, sql, std::forward<T>(t));
     }
 
     template<typename T>
     int insert(std::vector<T>& t)
     {
         std::string sql = generate_insert_sql<T>(false);
-        std::cout<<"insert prepare:"<<sql<<std::endl;
-        if (!prepare<T>(sql))
+        auto name = prepared_name<T>(sql);
+        if (name == nullptr)
             return 0;
 
         for (auto& item : t)
         {
-            if(!insert_impl(sql, item))
+            if(!insert_impl(*name, sql, item))
             {
                 execute("rollback;");
                 return 0;
@@ -240,41 +332,253 @@ public:
         return t.size();
     }
 
+    // writes every other field of the row whose key equals that of row, through a
+    // statement prepared once per connection. the key is the first field unless given.
+    template<typename T>
+    bool update_row(const T& row, const key_map& key = {})
+    {
+        std::string sql = generate_update_sql<T>(key);
+        auto name = prepared_name<T>(sql);
+        if (name == nullptr)
+            return false;
+        std::vector<param_value> param_values;
+        encode_row(row, param_values);
+        param_buffers buffers(param_values);
+        auto start = slow_query_log::instance().start();
+        res_ = PQexecPrepared(conn_, name->data(), buffers.size(), buffers.values.data(), buffers.lengths.data(),
+                              buffers.formats.data(), 0);
+        record_statement<T>(start, sql, buffers.printable());
+        bool ok = PQresultStatus(res_) == PGRES_COMMAND_OK;
+        if (!ok)
+            log_error(PQresultErrorMessage(res_));
+        PQclear(res_);
+        if (ok)
+            invalidate_cache<T>();
+        return ok;
+    }
+
+    // update T set b = $2, c = $3 where a = $1, placeholders follow the field order
+    template<typename T>
+    std::string generate_update_sql(const key_map& key = {})
+    {
+        std::set<std::string> keys;
+        std::string fields = key.fields.empty() ? std::string(reflection::get_array<T>()[0]) : key.fields;
+        std::stringstream ss(fields);
+        for (std::string field; std::getline(ss, field, ',');)
+        {
+            field.erase(0, field.find_first_not_of(' '));
+            field.erase(field.find_last_not_of(' ') + 1);
+            keys.insert(field);
+        }
+        std::string set_sql, where_sql;
+        auto names = reflection::get_array<T>();
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            std::string name(names[i]);
+            bool is_key = keys.count(name) > 0;
+            std::string& clause = is_key ? where_sql : set_sql;
+            if (!clause.empty())
+                clause += is_key ? " and " : ", ";
+            clause += name + " = $" + std::to_string(i + 1);
+        }
+        return "update " + std::string(reflection::get_name<T>()) + " set " + set_sql + " where " + where_sql + ";";
+    }
+
+    // one multi-row insert per chunk instead of one round trip per row,
+    // chunks are bounded by the 65535 parameters a single statement accepts
+    template<typename T>
+    int bulk_insert(const std::vector<T>& t)
+    {
+        constexpr size_t field_size = reflection::get_value<T>();
+        constexpr size_t max_rows = 65535 / field_size;
+        if (t.empty())
+            return 0;
+        bool chunked = t.size() > max_rows;
+        if (chunked && !execute("begin;"))
+            return 0;
+
+        std::vector<param_value> param_values;
+        for (size_t begin = 0; begin < t.size(); begin += max_rows)
+        {
+            size_t rows = std::min(max_rows, t.size() - begin);
+            std::string sql = generate_insert_sql<T>(false, rows);
+            log_trace("bulk insert:", reflection::get_name<T>(), " rows=", rows);
+            param_values.clear();
+            param_values.reserve(rows * field_size);
+            for (size_t r = begin; r < begin + rows; r++)
+            {
+                encode_row(t[r], param_values);
+            }
+            param_buffers buffers(param_values);
+            auto start = slow_query_log::instance().start();
+            res_ = PQexecParams(conn_, sql.data(), buffers.size(), buffers.types.data(),
+                                buffers.values.data(), buffers.lengths.data(), buffers.formats.data(), 0);
+            record_statement<T>(start, sql, buffers.printable());
+            if (PQresultStatus(res_) != PGRES_COMMAND_OK)
+            {
+                log_error(PQresultErrorMessage(res_));
+                PQclear(res_);
+                if (chunked)
+                    execute("rollback;");
+                return 0;
+            }
+            PQclear(res_);
+        }
+        if (chunked && !execute("commit;"))
+            return 0;
+        invalidate_cache<T>();
+        return t.size();
+    }
+
+    // installs a trigger that notifies key and operation of every changed row of T and
+    // delivers them as change_event<T> on a listener thread with its own connection.
+    // the key is one field of T, an event carries a single key value.
+    template<typename T, typename F>
+    std::unique_ptr<subscription> subscribe(const key_map& key, F&& callback)
+    {
+        auto key_index = reflection::get_index<T>(key.fields);
+        if (key_index >= reflection::get_value<T>())
+        {
+            log_error("subscribe needs a single key field of ", reflection::get_name<T>(), ", not ", key.fields);
+            return nullptr;
+        }
+        std::string table_name = reflection::get_name<T>().data();
+        std::string channel = "ormlite_" + table_name;
+        std::string sql = 
+            "create or replace function " + channel + "_notify() returns trigger as $$ "
+            "begin "
+            "if (TG_OP = 'DELETE') then "
+            "perform pg_notify('" + channel + "', TG_OP || ':' || OLD." + key.fields + "::text); "
+            "return OLD; "
+            "end if; "
+            "perform pg_notify('" + channel + "', TG_OP || ':' || NEW." + key.fields + "::text); "
+            "return NEW; "
+            "end; $$ language plpgsql; "
+            "drop trigger if exists " + channel + "_notify on " + table_name + "; "
+            "create trigger " + channel + "_notify after insert or update or delete on " + table_name + 
+            " for each row execute procedure " + channel + "_notify();";
+        log_trace("subscribe:", sql);
+        if (!execute(sql))
+        {
+            log_error(PQerrorMessage(conn_));
+            return nullptr;
+        }
+
+        auto on_payload = [callback, key_index](const char* payload) {
+            change_event<T> event{change_op::update, T{}};
+            if (parse_change(payload, key_index, event))
+                callback(std::move(event));
+        };
+        auto on_resync = [callback](const char*) {
+            callback(change_event<T>{change_op::resync, T{}});
+        };
+        return std::make_unique<subscription>(conninfo_, channel, on_payload, on_resync);
+    }
+
+    // cache shared with other connections, nullptr disables caching
+    void set_query_cache(std::shared_ptr<query_cache> cache)
+    {
+        cache_ = std::move(cache);
+    }
+
+    std::string error_message() const
+    {
+        return PQerrorMessage(conn_);
+    }
+
+    bool connected() const
+    {
+        return conn_ != nullptr && PQstatus(conn_) == CONNECTION_OK;
+    }
+
+    // opens a new session with the same parameters, for example after a failover.
+    // statements prepared in the old session are gone and are prepared again on use.
+    bool reconnect()
+    {
+        prepared_.clear();
+        if (conn_ == nullptr)
+            conn_ = PQconnectdb(conninfo_.data());
+        else
+            PQreset(conn_);
+        if (!connected())
+            log_error(PQerrorMessage(conn_));
+        return connected();
+    }
+
+    // named statements of this session by their text
+    prepared_statements& prepared()
+    {
+        return prepared_;
+    }
+
+    // libpq handle for statements the orm does not generate
+    PGconn* native_handle() const
+    {
+        return conn_;
+    }
+
+    // column type of a field, from the oid the codec table sends it with
+    static std::string type_name(const field_codec& field)
+    {
+        switch (field.oid)
+        {
+            case 21: return "smallint";
+            case 23: return "integer";
+            case 20: return "bigint";
+            case 700: return "real";
+            case 701: return "double precision";
+            case 25: return "text";
+            case 1043: return "varchar(" + std::to_string(field.size) + ")";
+            case 1082: return "date";
+            case 1184: return "timestamptz";
+            case 3802: return "jsonb";
+            case 17: return "bytea";
+            case 1005: return "smallint[]";
+            case 1007: return "integer[]";
+            case 1016: return "bigint[]";
+            case 1021: return "real[]";
+            case 1022: return "double precision[]";
+            case 1009: return "text[]";
+            case 1182: return "date[]";
+            case 1185: return "timestamptz[]";
+            default: return "";
+        }
+    }
+
     template <typename T>
-    constexpr auto get_type_names()
+    auto get_type_names()
     {
-        constexpr auto field_size = reflection::get_value<T>();
-        std::array<std::string, field_size> field_types;
-        reflection::for_each(T{}, [&](auto& item, auto field, auto j){
-            constexpr auto Idx = decltype(j)::value;
-            using U = std::remove_reference_t<decltype(reflection::get<Idx>(std::declval<T>()))>;
-            if constexpr(std::is_same_v<U, bool> || 
-                         std::is_same_v<U, int> || 
-                         std::is_same_v<U, int32_t> || 
-                         std::is_same_v<U, uint32_t> ||
-                         std::is_enum_v<U>)
-                { field_types[Idx] = "integer"; return; }
-            if constexpr(std::is_same_v<U, int8_t> || std::is_same_v<U, uint8_t> || 
-                         std::is_same_v<U, int16_t> || std::is_same_v<U, uint16_t>)  
-                { field_types[Idx] = "smallint"; return; }
-            if constexpr(std::is_same_v<U, int64_t> || std::is_same_v<U, uint64_t>)  
-                { field_types[Idx] = "bigint"; return; }
-            if constexpr(std::is_same_v<U, float>)  
-                { field_types[Idx] = "real"; return; }
-            if constexpr(std::is_same_v<U, double>)
-                { field_types[Idx] = "double precision"; return; }
-            if constexpr(std::is_same_v<U, std::string>)
-                { field_types[Idx] = "text"; return; }
-            if constexpr(std::is_array<U>::value)
-                { field_types[Idx] = "varchar(" + std::to_string(traits_utils::array_size<U>::value) + ")"; return; }
-        });
+        auto& table = codec_table<T>();
+        std::array<std::string, reflection::get_value<T>()> field_types;
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            field_types[i] = type_name(table[i]);
+        }
         return field_types;
     }
     template<typename T, typename... Args>
     std::string generate_create_table_sql(Args&&... args)
     {
         auto table_name = reflection::get_name<T>();
-        std::string sql = std::string("create table if not exists ") + table_name.data() + "(";
+        const storage_map* storage = nullptr;
+        const partition_map* partition = nullptr;
+        const index_map* indexes = nullptr;
+        const key_map* composite_key = nullptr;
+        auto options = std::forward_as_tuple(args...);
+        reflection::for_each(options, [&](auto& item, auto j){
+            using U = std::decay_t<decltype(item)>;
+            if constexpr (std::is_same_v<U, storage_map>)
+                storage = &item;
+            else if constexpr (std::is_same_v<U, partition_map>)
+                partition = &item;
+            else if constexpr (std::is_same_v<U, index_map>)
+                indexes = &item;
+            else if constexpr (std::is_same_v<U, key_map>)
+                composite_key = item.fields.find(',') != std::string::npos ? &item : nullptr;
+        });
+
+        std::string sql = std::string("create ") + (storage != nullptr && storage->unlogged ? "unlogged " : "") + 
+                          "table if not exists " + table_name.data() + "(";
         auto field_names = reflection::get_array<T>();
         auto field_types = get_type_names<T>();
         using TT = std::tuple<std::decay_t<Args>...>;
@@ -283,10 +587,12 @@ public:
             
             static_assert(!(traits_utils::has_type<key_map, TT>::value && traits_utils::has_type<auto_key_map, TT>::value), 
                         "key_map and auto_key_map cannot be used together");
+            static_assert(!(traits_utils::has_type<partition_map, TT>::value && traits_utils::has_type<auto_key_map, TT>::value), 
+                        "a serial key cannot contain the partition fields");
 
         }
 
-        auto tp = sort_tuple(std::make_tuple(std::forward<Args>(args)...));
+        auto tp = sort_tuple(std::make_tuple(args...));
         constexpr auto field_size = reflection::get_value<T>();
         static_assert(field_size == field_names.size(), "field_size != field_names.size");
         for (size_t i = 0; i < field_size; i++)
@@ -348,33 +654,112 @@ public:
             if( i < field_size-1)
                 sql += ", ";
         }
-        sql += ");";
+        if (composite_key != nullptr)
+        {
+            sql += ", primary key (" + composite_key->fields + ")";
+        }
+        sql += ")";
+        if (partition != nullptr)
+        {
+            const char* types[] = {"range", "list", "hash"};
+            sql += std::string(" partition by ") + types[(int)partition->type] + " (" + partition->fields + ")";
+        }
+        if (storage != nullptr && storage->fillfactor > 0)
+        {
+            sql += " with (fillfactor = " + std::to_string(storage->fillfactor) + ")";
+        }
+        sql += ";";
+
+        if (indexes != nullptr)
+        {
+            for (auto& index : indexes->indexes)
+            {
+                sql += std::string(" create ") + (index.unique ? "unique " : "") + "index if not exists " + index_name(table_name, index) + 
+                       " on " + table_name.data() + " using " + index.method + " (" + index.fields + ")";
+                if (!index.include.empty())
+                    sql += " include (" + index.include + ")";
+                if (!index.where.empty())
+                    sql += " where (" + index.where + ")";
+                sql += ";";
+            }
+        }
         return sql;
     }
 
+    // partition of a range partitioned table covering [from, to), e.g. create_partition<metric>("2023_05", "2023-05-01", "2023-06-01")
+    template<typename T>
+    bool create_partition(const std::string& suffix, const std::string& from, const std::string& to)
+    {
+        std::string table_name = reflection::get_name<T>().data();
+        std::string sql = "create table if not exists " + table_name + "_" + suffix + " partition of " + table_name + 
+                          " for values from ('" + from + "') to ('" + to + "');";
+        log_trace("create:", sql);
+        return execute(sql);
+    }
+
+    template<typename T>
+    bool create_hash_partition(const std::string& suffix, int modulus, int remainder)
+    {
+        std::string table_name = reflection::get_name<T>().data();
+        std::string sql = "create table if not exists " + table_name + "_" + suffix + " partition of " + table_name + 
+                          " for values with (modulus " + std::to_string(modulus) + ", remainder " + std::to_string(remainder) + ");";
+        log_trace("create:", sql);
+        return execute(sql);
+    }
+
+    // retention: dropping a partition replaces deleting its rows
+    template<typename T>
+    bool drop_partition(const std::string& suffix)
+    {
+        std::string sql = std::string("drop table if exists ") + reflection::get_name<T>().data() + "_" + suffix + ";";
+        log_trace("drop:", sql);
+        return execute(sql);
+    }
+
     template<typename T>
     constexpr typename std::enable_if<reflection::is_reflection<T>::value, pg_query_object::query_object<T>>::type query()
     {
-        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>());
+        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>(), cache_.get(), &prepared_);
+    }
+
+    // the rows whose key is one of keys, in one statement whose text does not depend on
+    // how many keys there are. the key is the first field of T unless given.
+    template<typename T, typename Container>
+    std::vector<T> get_by_keys(const Container& keys, const key_map& key = {})
+    {
+        std::string field = key.fields.empty() ? std::string(reflection::get_array<T>()[0]) : key.fields;
+        return query<T>().where(pg_query_object::expr(field, reflection::get_name<T>()).in(keys)).to_vector();
+    }
+
+#ifdef LIBPQ_HAS_PIPELINING
+    // runs independent queries in one round trip and returns their rows in order, a query
+    // that fails yields an empty vector and aborts the ones after it. the statements are
+    // pipelined with their parameters, which needs libpq 14 or later.
+    template<typename... Queries>
+    std::tuple<std::vector<typename std::decay_t<Queries>::result_type>...> batch(Queries&&... queries)
+    {
+        log_trace("batch:", sizeof...(Queries), " statements");
+        return batch_impl(std::index_sequence_for<Queries...>{}, queries...);
     }
+#endif
 
     template<typename T>
     constexpr typename std::enable_if<reflection::is_reflection<T>::value, pg_query_object::query_object<T>>::type del()
     {
-        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>(), "delete", "");
+        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>(), "delete", "", cache_.get(), &prepared_);
     }
 
     template<typename T>
     constexpr typename std::enable_if<reflection::is_reflection<T>::value, pg_query_object::query_object<T>>::type update()
     {
-        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>(), "", "update");
+        return pg_query_object::query_object<T>(conn_, reflection::get_name<T>(), "", "update", cache_.get(), &prepared_);
     }
 
     ~pg_connection()
     {
         if(conn_ != nullptr)
         {
-            std::cout<<"release pg conn"<<std::endl;
+            log_trace("release pg conn");
             PQfinish(conn_);
             conn_ = nullptr;
         } 
@@ -383,12 +768,103 @@ public:
     bool execute(const std::string& sql)
     {
         res_ = PQexec(conn_, sql.data());
-        return PQresultStatus(res_) == PGRES_COMMAND_OK;
+        bool ok = PQresultStatus(res_) == PGRES_COMMAND_OK;
+        PQclear(res_);
+        return ok;
     }
 
 private:
+#ifdef LIBPQ_HAS_PIPELINING
+    template<std::size_t... Idx, typename... Queries>
+    auto batch_impl(std::index_sequence<Idx...>, Queries&... queries)
+    {
+        std::tuple<std::vector<typename Queries::result_type>...> results;
+        std::array<std::string, sizeof...(Queries)> sqls = {queries.to_string()...};
+        auto start = slow_query_log::instance().start();
+        if (!PQenterPipelineMode(conn_))
+        {
+            log_error(PQerrorMessage(conn_));
+            return results;
+        }
+        // a statement that fails aborts the ones after it, they are still answered
+        std::size_t sent = 0;
+        bool sending = true;
+        auto send = [&](auto& query, const std::string& sql) {
+            param_buffers buffers(query.params());
+            auto name = prepared_.find(sql, buffers.types);
+            sending = sending && (name == nullptr ?
+                PQsendQueryParams(conn_, sql.data(), buffers.size(), buffers.types.data(), buffers.values.data(),
+                                  buffers.lengths.data(), buffers.formats.data(), 1) :
+                PQsendQueryPrepared(conn_, name->data(), buffers.size(), buffers.values.data(),
+                                    buffers.lengths.data(), buffers.formats.data(), 1));
+            sent += sending;
+        };
+        (send(queries, sqls[Idx]), ...);
+        if (!sending)
+            log_error(PQerrorMessage(conn_));
+        if (PQpipelineSync(conn_))
+        {
+            auto receive = [&](auto& query, auto& rows, std::size_t index) {
+                if (index >= sent)
+                    return;
+                PGresult* res = PQgetResult(conn_);
+                // the null that ends the results of this statement
+                while (PGresult* extra = PQgetResult(conn_))
+                {
+                    PQclear(extra);
+                }
+                decode_batched(query, rows, res, sqls[index], start);
+            };
+            (receive(queries, std::get<Idx>(results), Idx), ...);
+            PGresult* sync = PQgetResult(conn_);
+            if (PQresultStatus(sync) != PGRES_PIPELINE_SYNC)
+                log_error("batch: pipeline out of sync");
+            PQclear(sync);
+        }
+        PQexitPipelineMode(conn_);
+        return results;
+    }
+
+    // the batch latency is recorded for every statement of it
+    template<typename Query, typename Rows>
+    void decode_batched(Query& query, Rows& rows, PGresult* res, const std::string& sql, std::chrono::steady_clock::time_point start)
+    {
+        pg_backend::cursor cursor(res);
+        if (cursor.ok())
+            rows = query.collect(cursor);
+        else
+            log_error(cursor.error());
+        if (start == std::chrono::steady_clock::time_point{})
+            return;
+        param_buffers buffers(query.params());
+        slow_query_log::instance().finish(start, query.table_name(), sql, (long)rows.size(), cursor.ok(), buffers.printable());
+    }
+#endif
+
+    template<typename T>
+    void record_statement(std::chrono::steady_clock::time_point start, const std::string& sql, 
+                          const std::vector<const char*>& params)
+    {
+        if (start == std::chrono::steady_clock::time_point{})
+            return;
+        using U = std::remove_const_t<std::remove_reference_t<T>>;
+        bool ok = PQresultStatus(res_) == PGRES_COMMAND_OK;
+        slow_query_log::instance().finish(start, reflection::get_name<U>(), sql, atol(PQcmdTuples(res_)), ok, params);
+    }
+
+    template<typename T>
+    void invalidate_cache()
+    {
+        using U = std::remove_const_t<std::remove_reference_t<T>>;
+        if (cache_ != nullptr)
+            cache_->invalidate(std::string(reflection::get_name<U>()));
+    }
+
     PGresult *res_ = nullptr;
     PGconn *conn_ = nullptr;
+    std::string conninfo_;
+    std::shared_ptr<query_cache> cache_;
+    prepared_statements prepared_;
 };
 
 }
@@ -0,0 +1,292 @@
+#ifndef PG_PARALLEL_SCAN_HPP
+#define PG_PARALLEL_SCAN_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "pg_pool.hpp"
+
+namespace pg_ormlite
+{
+
+// reads a whole table over several pooled connections at once. the table is split into
+// block ranges, or into ranges of an integer key, and every range is read by its own
+// worker. all workers see one snapshot, exported by a coordinator connection that stays
+// in its transaction until the scan ends, so the union is a consistent copy of the table.
+template<typename T>
+class parallel_scan
+{
+public:
+    parallel_scan(std::shared_ptr<connection_pool> pool, std::size_t workers)
+    : pool_(std::move(pool)), workers_(workers == 0 ? 1 : workers)
+    {
+
+    }
+
+    // the values the filter binds are sent with the cursor of every worker
+    inline parallel_scan&& where(const pg_query_object::expr& expression)
+    {
+        where_ = pg_query_object::clause(expression.to_string(), expression.params());
+        return std::move(*this);
+    }
+
+    // split by ranges of the key instead of ctid blocks, the bounds come from the
+    // pg_stats histogram of the column and from its min and max without statistics
+    inline parallel_scan&& by_key(const key_map& key)
+    {
+        key_ = key.fields;
+        return std::move(*this);
+    }
+
+    // rows every worker fetches from its server side cursor at a time
+    inline parallel_scan&& fetch_size(std::size_t n)
+    {
+        fetch_size_ = n == 0 ? 1 : n;
+        return std::move(*this);
+    }
+
+    // consumer(T&&) is called for every row. calls are serialized, so it needs no locking,
+    // but rows of different ranges interleave. the pool needs room for the coordinator
+    // and at least one worker. an exception thrown by the consumer stops the scan and is
+    // rethrown here once every worker has finished.
+    template<typename F>
+    bool run(F&& consumer)
+    {
+        if (pool_->capacity() < 2)
+        {
+            log_error("parallel scan needs a pool of at least 2 connections, the pool has ", pool_->capacity());
+            return false;
+        }
+        auto coordinator = pool_->acquire();
+        PGconn* conn = coordinator->native_handle();
+        if (!exec(conn, "begin isolation level repeatable read;"))
+            return false;
+        std::string snapshot;
+        {
+            pg_backend::statement stmt(conn, "select pg_export_snapshot();");
+            auto cursor = stmt.step();
+            if (cursor.ok() && cursor.next())
+                cursor.get(0, snapshot);
+        }
+        if (snapshot.empty())
+        {
+            log_error("export snapshot failed:", pg_backend::error_message(conn));
+            exec(conn, "rollback;");
+            return false;
+        }
+        auto ranges = key_.empty() || !integer_key() ? block_ranges(conn) : key_ranges(conn);
+        log_trace("parallel scan:", table_, " ranges=", ranges.size());
+
+        std::mutex deliver;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::vector<std::thread> threads;
+        for (auto& range : ranges)
+        {
+            threads.emplace_back([&, range]() {
+                if (!scan_range(snapshot, range, deliver, failed, error, consumer))
+                    failed = true;
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        exec(conn, "commit;");
+        if (error)
+            std::rethrow_exception(error);
+        return !failed;
+    }
+
+private:
+    template<typename F>
+    bool scan_range(const std::string& snapshot, const std::string& range, std::mutex& deliver, std::atomic<bool>& failed,
+                    std::exception_ptr& error, F& consumer)
+    {
+        auto lease = pool_->acquire();
+        PGconn* conn = lease->native_handle();
+        // the range bounds are literals, so the filter keeps its placeholders as they are
+        std::string sql = "select * from " + table_ + " where " +
+                          (where_.empty() ? range : "(" + where_.sql + ") and " + range);
+        bool ok = exec(conn, "begin isolation level repeatable read;") &&
+                  exec(conn, "set transaction snapshot '" + snapshot + "';") &&
+                  exec(conn, "declare scan no scroll cursor for " + sql + ";", where_.params);
+        std::string fetch = "fetch " + std::to_string(fetch_size_) + " from scan;";
+        std::vector<T> rows;
+        while (ok && !failed)
+        {
+            pg_backend::statement stmt(conn, fetch);
+            auto cursor = stmt.step();
+            if (!cursor.ok())
+            {
+                log_error(cursor.error());
+                ok = false;
+                break;
+            }
+            rows.clear();
+            while (cursor.next())
+            {
+                T row = {};
+                cursor.get_row(row);
+                rows.push_back(std::move(row));
+            }
+            if (rows.empty())
+                break;
+            // the first exception is kept under the lock, the other workers see failed and stop
+            std::lock_guard<std::mutex> lock(deliver);
+            if (failed)
+                break;
+            try
+            {
+                for (auto& row : rows)
+                {
+                    consumer(std::move(row));
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+                failed = true;
+                ok = false;
+            }
+        }
+        exec(conn, ok ? "commit;" : "rollback;");
+        return ok;
+    }
+
+    // equal ranges of heap blocks, read with tid range scans. the last range is open
+    // so that blocks added since the size was read are covered too.
+    std::vector<std::string> block_ranges(PGconn* conn)
+    {
+        long long blocks = scalar(conn, "select (pg_relation_size('" + table_ + "') / current_setting('block_size')::int)::bigint;");
+        std::vector<long long> cuts;
+        for (std::size_t i = 1; i < workers_; i++)
+        {
+            cuts.push_back(blocks * (long long)i / (long long)workers_);
+        }
+        return split(cuts, [](long long block) { return "'(" + std::to_string(block) + ",0)'::tid"; }, "ctid");
+    }
+
+    // quantiles of the histogram keep the ranges even on skewed keys
+    std::vector<std::string> key_ranges(PGconn* conn)
+    {
+        std::vector<long long> bounds;
+        {
+            pg_backend::statement stmt(conn, "select histogram_bounds::text from pg_stats where schemaname = current_schema() "
+                                             "and tablename = '" + table_ + "' and attname = '" + key_ + "';");
+            auto cursor = stmt.step();
+            std::string text;
+            if (cursor.ok() && cursor.next())
+                cursor.get(0, text);
+            bounds = parse_bounds(text);
+        }
+        std::vector<long long> cuts;
+        if (bounds.size() >= 2)
+        {
+            for (std::size_t i = 1; i < workers_; i++)
+            {
+                cuts.push_back(bounds[bounds.size() * i / workers_]);
+            }
+        }
+        else
+        {
+            long long low = scalar(conn, "select min(" + key_ + ")::bigint from " + table_ + ";");
+            long long high = scalar(conn, "select max(" + key_ + ")::bigint from " + table_ + ";");
+            for (std::size_t i = 1; i < workers_; i++)
+            {
+                cuts.push_back(low + (long long)((high - low) * (double)i / workers_));
+            }
+        }
+        return split(cuts, [](long long key) { return std::to_string(key); }, key_);
+    }
+
+    // "{1,35,70}" as numbers
+    static std::vector<long long> parse_bounds(const std::string& text)
+    {
+        std::vector<long long> bounds;
+        const char* p = text.data();
+        while (*p != '\0')
+        {
+            if (*p != '{' && *p != ',')
+            {
+                p++;
+                continue;
+            }
+            char* end = nullptr;
+            long long value = strtoll(p + 1, &end, 10);
+            if (end != p + 1)
+                bounds.push_back(value);
+            p = end;
+        }
+        return bounds;
+    }
+
+    // the first range is open below and the last open above, so every row falls in exactly one
+    template<typename Render>
+    static std::vector<std::string> split(std::vector<long long> cuts, Render render, const std::string& column)
+    {
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+        if (cuts.empty())
+            return {"true"};
+        std::vector<std::string> ranges;
+        ranges.push_back(column + " < " + render(cuts.front()));
+        for (std::size_t i = 1; i < cuts.size(); i++)
+        {
+            ranges.push_back("(" + column + " >= " + render(cuts[i - 1]) + " and " + column + " < " + render(cuts[i]) + ")");
+        }
+        ranges.push_back(column + " >= " + render(cuts.back()));
+        return ranges;
+    }
+
+    bool integer_key() const
+    {
+        bool integer = false;
+        reflection::for_each(T{}, [&](auto item, auto field, auto j){
+            using U = remove_optional_t<std::remove_reference_t<decltype(std::declval<T>().*item)>>;
+            if (field == key_)
+                integer = std::is_integral_v<U>;
+        });
+        if (!integer)
+            log_error("parallel scan by ", key_, " needs an integer key, splitting by blocks");
+        return integer;
+    }
+
+    static long long scalar(PGconn* conn, const std::string& sql)
+    {
+        pg_backend::statement stmt(conn, sql);
+        auto cursor = stmt.step();
+        long long value = 0;
+        if (cursor.ok() && cursor.next())
+            cursor.get(0, value);
+        else
+            log_error(cursor.error());
+        return value;
+    }
+
+    static bool exec(PGconn* conn, const std::string& sql, const std::vector<param_value>& params = {})
+    {
+        pg_backend::statement stmt(conn, sql);
+        for (std::size_t i = 0; i < params.size(); i++)
+        {
+            stmt.bind_param((int)i + 1, params[i]);
+        }
+        auto cursor = stmt.step();
+        if (!cursor.ok())
+            log_error(cursor.error());
+        return cursor.ok();
+    }
+
+    std::shared_ptr<connection_pool> pool_;
+    std::size_t workers_;
+    std::string table_ = std::string(reflection::get_name<T>());
+    pg_query_object::clause where_;
+    std::string key_;
+    std::size_t fetch_size_ = 10000;
+};
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef PG_PLAN_GUARD_HPP
+#define PG_PLAN_GUARD_HPP
+#include <fstream>
+#include <map>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+struct plan_expectation
+{
+    bool forbid_seq_scan = true;
+    // 0 disables the absolute limit
+    double max_total_cost = 0;
+    // allowed growth of the total cost against the baseline, 0 disables the check
+    double max_cost_ratio = 1.5;
+};
+
+struct plan_failure
+{
+    std::string name;
+    std::string reason;
+    query_plan plan;
+};
+
+// plan regression harness: registered orm queries are explained against a real database
+// and checked for seq scans and cost growth against a recorded baseline
+class plan_guard
+{
+public:
+    explicit plan_guard(pg_connection& conn) : conn_(conn)
+    {
+
+    }
+
+    // make_query(conn) builds the query_object to check, e.g. [](auto& c){ return c.query<person>().where(...); }
+    template<typename F>
+    void add(const std::string& name, F&& make_query, plan_expectation expectation = {})
+    {
+        checks_.push_back({name, expectation, [this, make_query](bool analyze) {
+            return make_query(conn_).explain(analyze, analyze);
+        }});
+    }
+
+    // returns the failed checks, an empty vector means every plan passed
+    std::vector<plan_failure> run(bool analyze = false)
+    {
+        std::vector<plan_failure> failures;
+        for (auto& check : checks_)
+        {
+            query_plan plan = check.explain(analyze);
+            if (!plan.valid())
+            {
+                failures.push_back({check.name, "explain failed", plan});
+                continue;
+            }
+            if (check.expectation.forbid_seq_scan && plan.has_seq_scan())
+            {
+                failures.push_back({check.name, "seq scan", plan});
+                continue;
+            }
+            double cost = plan.root.total_cost;
+            if (check.expectation.max_total_cost > 0 && cost > check.expectation.max_total_cost)
+            {
+                failures.push_back({check.name, "cost " + std::to_string(cost) + " above " + 
+                                    std::to_string(check.expectation.max_total_cost), plan});
+                continue;
+            }
+            auto base = baseline_.find(check.name);
+            if (check.expectation.max_cost_ratio > 0 && base != baseline_.end() && base->second > 0 &&
+                cost > base->second * check.expectation.max_cost_ratio)
+            {
+                failures.push_back({check.name, "cost " + std::to_string(cost) + " grew from baseline " + 
+                                    std::to_string(base->second), plan});
+                continue;
+            }
+            current_[check.name] = cost;
+        }
+        for (auto& failure : failures)
+        {
+            log_error("plan regression:", failure.name, ", ", failure.reason);
+        }
+        return failures;
+    }
+
+    // one "name cost" pair per line, names must not contain whitespace
+    bool load_baseline(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        std::string name;
+        double cost = 0;
+        while (in >> name >> cost)
+        {
+            baseline_[name] = cost;
+        }
+        return true;
+    }
+
+    // records the costs of the checks that passed in the last run
+    bool save_baseline(const std::string& path) const
+    {
+        std::ofstream out(path);
+        for (auto& item : current_)
+        {
+            out << item.first << " " << item.second << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+private:
+    struct check
+    {
+        std::string name;
+        plan_expectation expectation;
+        std::function<query_plan(bool)> explain;
+    };
+
+    pg_connection& conn_;
+    std::vector<check> checks_;
+    std::map<std::string, double> baseline_;
+    std::map<std::string, double> current_;
+};
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef PG_POOL_HPP
+#define PG_POOL_HPP
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+// fixed size pool of connections to one server. connections are opened on demand,
+// a lease returns its connection when the last copy is released.
+class connection_pool
+{
+public:
+    // the arguments are those of pg_connection: host, port, user, password, dbname[, connect_timeout]
+    template<typename... Args>
+    explicit connection_pool(std::size_t size, Args... args)
+    : state_(std::make_shared<state>())
+    {
+        state_->capacity = size == 0 ? 1 : size;
+        state_->factory = [args...]() { return std::make_unique<pg_connection>(args...); };
+    }
+
+    connection_pool(const connection_pool&) = delete;
+    connection_pool& operator=(const connection_pool&) = delete;
+
+    // blocks while every connection is leased
+    std::shared_ptr<pg_connection> acquire()
+    {
+        std::unique_ptr<pg_connection> conn;
+        {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            state_->cv.wait(lock, [this]() { return !state_->idle.empty() || state_->opened < state_->capacity; });
+            state_->leased++;
+            if (!state_->idle.empty())
+            {
+                conn = std::move(state_->idle.back());
+                state_->idle.pop_back();
+            }
+            else
+            {
+                state_->opened++;
+            }
+        }
+        if (conn == nullptr)
+        {
+            // a connection that throws while it opens gives its slot back
+            try
+            {
+                conn = state_->open();
+            }
+            catch (...)
+            {
+                state_->abandon();
+                throw;
+            }
+        }
+        auto owner = state_;
+        return std::shared_ptr<pg_connection>(conn.release(), [owner](pg_connection* released) {
+            owner->give_back(std::unique_ptr<pg_connection>(released));
+        });
+    }
+
+    // leases currently held, the load measure for balancing
+    std::size_t outstanding() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->leased;
+    }
+
+    std::size_t capacity() const
+    {
+        return state_->capacity;
+    }
+
+    // runs on every connection the pool opens before it is leased, including those that
+    // replace broken ones after a failover, e.g. to prepare statements with a
+    // warmup_registry. set it before the first acquire.
+    void on_connect(std::function<void(pg_connection&)> hook)
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->on_connect = std::move(hook);
+    }
+
+    // opens up to n connections ahead of the first request, returns how many are idle
+    std::size_t prewarm(std::size_t n)
+    {
+        std::vector<std::shared_ptr<pg_connection>> leases;
+        while (leases.size() < n)
+        {
+            {
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                if (state_->idle.empty() && state_->opened >= state_->capacity)
+                    break;
+            }
+            leases.push_back(acquire());
+        }
+        leases.clear();
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->idle.size();
+    }
+
+private:
+    struct state
+    {
+        // a broken connection is closed instead of pooled, the next acquire opens a new one
+        void give_back(std::unique_ptr<pg_connection> conn)
+        {
+            bool healthy = conn->connected();
+            if (!healthy)
+                conn.reset();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                leased--;
+                if (healthy)
+                    idle.push_back(std::move(conn));
+                else
+                    opened--;
+            }
+            cv.notify_one();
+        }
+
+        // the slot of a lease whose connection never opened
+        void abandon()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                leased--;
+                opened--;
+            }
+            cv.notify_one();
+        }
+
+        std::unique_ptr<pg_connection> open()
+        {
+            auto conn = factory();
+            std::function<void(pg_connection&)> hook;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                hook = on_connect;
+            }
+            if (hook && conn->connected())
+                hook(*conn);
+            return conn;
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::unique_ptr<pg_connection>> idle;
+        std::size_t capacity = 1;
+        std::size_t opened = 0;
+        std::size_t leased = 0;
+        std::function<std::unique_ptr<pg_connection>()> factory;
+        std::function<void(pg_connection&)> on_connect;
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef PG_QUERY_CACHE_HPP
+#define PG_QUERY_CACHE_HPP
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace pg_ormlite
+{
+
+// result cache shared by any number of connections. entries are keyed by the rendered
+// statement, bounded by an estimated byte size with lru eviction and expire after a ttl.
+// insert/update/del through a connection that uses the cache drop every entry of that
+// table; statements sent through pg_connection::execute are not tracked.
+class query_cache
+{
+public:
+    query_cache(std::size_t max_bytes, std::chrono::milliseconds ttl) : max_bytes_(max_bytes), ttl_(ttl)
+    {
+
+    }
+
+    query_cache(const query_cache&) = delete;
+    query_cache& operator=(const query_cache&) = delete;
+
+    // load is called as load(bool& ok, std::size_t& bytes) and returns std::vector<R>.
+    // concurrent misses on the same key wait for a single load instead of querying again.
+    // the same statement decoded into another row type is another entry. an exception
+    // thrown by load reaches the caller, waiters then load for themselves.
+    template<typename R, typename F>
+    std::vector<R> get_or_load(const std::string& table, const std::string& statement_key, F&& load)
+    {
+        const std::string key = statement_key + '\0' + typeid(R).name();
+        std::shared_ptr<flight> wait_for;
+        std::size_t generation = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end())
+            {
+                if (std::chrono::steady_clock::now() < it->second.expires)
+                {
+                    lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+                    hits_++;
+                    return *std::static_pointer_cast<const std::vector<R>>(it->second.data);
+                }
+                erase(it);
+            }
+            misses_++;
+            auto in_flight = flights_.find(key);
+            if (in_flight != flights_.end())
+            {
+                wait_for = in_flight->second;
+            }
+            else
+            {
+                flights_.emplace(key, std::make_shared<flight>());
+                generation = generations_[table];
+            }
+        }
+
+        if (wait_for != nullptr)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wait_for->cv.wait(lock, [&wait_for] { return wait_for->done; });
+            if (wait_for->ok)
+                return *std::static_pointer_cast<const std::vector<R>>(wait_for->data);
+            lock.unlock();
+            bool ok = false;
+            std::size_t bytes = 0;
+            return load(ok, bytes);
+        }
+
+        bool ok = false;
+        std::size_t bytes = 0;
+        std::shared_ptr<const std::vector<R>> data;
+        try
+        {
+            data = std::make_shared<const std::vector<R>>(load(ok, bytes));
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            land(key, false, nullptr);
+            throw;
+        }
+        bytes += sizeof(R) * data->size() + key.size();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        land(key, ok, data);
+
+        // a write to the table while loading makes this result stale
+        if (ok && bytes <= max_bytes_ && generations_[table] == generation)
+        {
+            lru_.push_front(key);
+            entry e{data, table, bytes, std::chrono::steady_clock::now() + ttl_, lru_.begin()};
+            entries_.emplace(key, std::move(e));
+            tables_[table].insert(key);
+            used_bytes_ += bytes;
+            while (used_bytes_ > max_bytes_)
+            {
+                erase(entries_.find(lru_.back()));
+            }
+        }
+        return *data;
+    }
+
+    void invalidate(const std::string& table)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generations_[table]++;
+        auto it = tables_.find(table);
+        if (it == tables_.end())
+            return;
+        auto keys = std::move(it->second);
+        tables_.erase(it);
+        for (auto& key : keys)
+        {
+            auto entry_it = entries_.find(key);
+            if (entry_it != entries_.end())
+            {
+                used_bytes_ -= entry_it->second.bytes;
+                lru_.erase(entry_it->second.lru_pos);
+                entries_.erase(entry_it);
+            }
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& item : tables_)
+        {
+            generations_[item.first]++;
+        }
+        entries_.clear();
+        tables_.clear();
+        lru_.clear();
+        used_bytes_ = 0;
+    }
+
+    std::size_t size_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return used_bytes_;
+    }
+
+    std::size_t hits() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+
+    std::size_t misses() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+private:
+    struct entry
+    {
+        std::shared_ptr<const void> data;
+        std::string table;
+        std::size_t bytes;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    struct flight
+    {
+        std::condition_variable cv;
+        bool done = false;
+        bool ok = false;
+        std::shared_ptr<const void> data;
+    };
+
+    // ends the load of key and wakes its waiters, called with the mutex held
+    void land(const std::string& key, bool ok, std::shared_ptr<const void> data)
+    {
+        auto in_flight = flights_.find(key);
+        auto current = in_flight->second;
+        flights_.erase(in_flight);
+        current->ok = ok;
+        current->data = std::move(data);
+        current->done = true;
+        current->cv.notify_all();
+    }
+
+    void erase(std::unordered_map<std::string, entry>::iterator it)
+    {
+        used_bytes_ -= it->second.bytes;
+        lru_.erase(it->second.lru_pos);
+        auto table_it = tables_.find(it->second.table);
+        if (table_it != tables_.end())
+        {
+            table_it->second.erase(it->first);
+            if (table_it->second.empty())
+                tables_.erase(table_it);
+        }
+        entries_.erase(it);
+    }
+
+    mutable std::mutex mutex_;
+    std::size_t max_bytes_;
+    std::chrono::milliseconds ttl_;
+    std::size_t used_bytes_ = 0;
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+
+    std::list<std::string> lru_;
+    std::unordered_map<std::string, entry> entries_;
+    std::unordered_map<std::string, std::unordered_set<std::string>> tables_;
+    std::unordered_map<std::string, std::size_t> generations_;
+    std::unordered_map<std::string, std::shared_ptr<flight>> flights_;
+};
+
+}
+
+#endif
@@ -1,10 +1,18 @@
 #ifndef PG_QUERY_OBJECT_HPP
 #define PG_QUERY_OBJECT_HPP
 #include <cassert>
+#include <cctype>
 #include <iostream>
 #include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <libpq-fe.h>
 #include "reflection.hpp"
+#include "pg_backend.hpp"
+#include "pg_query_cache.hpp"
+#include "pg_explain.hpp"
+#include "pg_slow_query_log.hpp"
 
 namespace pg_query_object
 {
@@ -13,41 +21,246 @@ template<typename RNT_TYPE>
 struct selectable
 {
     selectable(std::string_view&& field, std::string_view&& tbl_name, std::string_view&& op) 
-    : expr_(std::string(op) + "(" + std::string(field) + ")"), tbl_name_(tbl_name){};
+    : expr_(std::string(op) + "(" + std::string(field) + ")"), 
+      qualified_(std::string(op) + "(" + std::string(tbl_name) + "." + std::string(field) + ")"), tbl_name_(tbl_name), op_(op){};
 
     inline std::string to_string() const
     {
         return expr_;
     }
 
+    inline std::string qualified() const
+    {
+        return qualified_;
+    }
+
     inline std::string table_name() const
     {
         return tbl_name_;
     }
 
+    // aggregate function name, empty for a plain column
+    inline std::string op() const
+    {
+        return op_;
+    }
+
     RNT_TYPE return_type;
 
 private:
     std::string expr_;
+    std::string qualified_;
     std::string tbl_name_;
+    std::string op_;
     
 };
 
+// renumbers the $n placeholders of a clause by offset, quoted text is left alone.
+// every expression numbers its own parameters from $1, combining two shifts the right one.
+inline std::string shift_placeholders(const std::string& sql, std::size_t offset)
+{
+    if (offset == 0)
+        return sql;
+    std::string shifted;
+    shifted.reserve(sql.size() + 8);
+    char quote = 0;
+    for (std::size_t i = 0; i < sql.size(); i++)
+    {
+        char c = sql[i];
+        if (quote == 0 && c == '$' && i + 1 < sql.size() && isdigit((unsigned char)sql[i + 1]))
+        {
+            std::size_t n = 0;
+            while (i + 1 < sql.size() && isdigit((unsigned char)sql[i + 1]))
+            {
+                n = n * 10 + (sql[++i] - '0');
+            }
+            shifted += "$" + std::to_string(n + offset);
+            continue;
+        }
+        if (quote == 0 && (c == '\'' || c == '"'))
+            quote = c;
+        else if (c == quote)
+            quote = 0;
+        shifted += c;
+    }
+    return shifted;
+}
+
+// a piece of a statement with the values of its placeholders, which count from $1
+// within the clause. a statement numbers them once, in the order its clauses appear
+// in the text, so replacing a clause drops its values and clauses may be added in any order.
+struct clause
+{
+    std::string sql;
+    std::vector<pg_ormlite::param_value> params;
+
+    clause() = default;
+
+    explicit clause(std::string text, std::vector<pg_ormlite::param_value> values = {})
+    : sql(std::move(text)), params(std::move(values)) {};
+
+    // text without placeholders
+    clause& append(const std::string& text)
+    {
+        sql += text;
+        return *this;
+    }
+
+    clause& append(const clause& other)
+    {
+        sql += shift_placeholders(other.sql, params.size());
+        params.insert(params.end(), other.params.begin(), other.params.end());
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return sql.empty();
+    }
+};
+
+template <typename T, typename = void>
+struct is_query : std::false_type {};
+
+template <typename T>
+struct is_query<T, std::void_t<decltype(std::declval<T&>().to_subquery())>> : std::true_type {};
+
 class expr
 {
 public:
-    expr(std::string_view&& field, std::string_view&& tbl_name) : expr_(field), tbl_name_(tbl_name) {};
+    expr(std::string_view&& field, std::string_view&& tbl_name) 
+    : expr_(field), qualified_(std::string(tbl_name) + "." + std::string(field)), tbl_name_(tbl_name) {};
 
+    // sql literal for a value, quotes inside strings are doubled
     template <typename T>
-    expr make_expr(std::string&& op, T value)
+    static std::string literal(const T& value)
     {
         using U = std::decay_t<T>;
         if constexpr (std::is_array<U>::value || std::is_same_v<U, std::string> || std::is_same_v<U, const char*>)
-            return expr (expr_ + " " + op + " " + "'" + value + "'", tbl_name_);
-        else if constexpr (std::is_same_v<T, expr>)
-            return expr (expr_ + " " + op + " " + value.expr_, tbl_name_);
+        {
+            std::string_view text;
+            if constexpr (std::is_array<U>::value)
+                text = std::string_view(value, strnlen(value, sizeof(U)));
+            else
+                text = value;
+            std::string quoted = "'";
+            for (char c : text)
+            {
+                quoted += c;
+                if (c == '\'')
+                    quoted += c;
+            }
+            return quoted + "'";
+        }
+        else if constexpr (std::is_same_v<U, expr>)
+            return value.expr_;
+        else if constexpr (std::is_enum_v<U>)
+            return std::to_string(static_cast<std::underlying_type_t<U>>(value));
+        else if constexpr (pg_ormlite::is_date<U>())
+            return "(date '2000-01-01' + " + std::to_string(pg_ormlite::time_count(value)) + ")";
+        else if constexpr (pg_ormlite::is_time_point<U>::value)
+            return "(timestamptz '2000-01-01 00:00:00+00' + " + std::to_string(pg_ormlite::time_count(value)) + " * interval '1 microsecond')";
         else
-            return expr (expr_ + " " + op + " " + std::to_string(value), tbl_name_);
+            return std::to_string(value);
+    }
+
+    template <typename T>
+    expr make_expr(std::string&& op, T value)
+    {
+        if constexpr (std::is_same_v<std::decay_t<T>, expr>)
+        {
+            // columns of two tables are named with their table even outside a join, in a
+            // correlated subquery a bare column of the outer table binds to an inner one
+            bool across = !tbl_name_.empty() && !value.tbl_name_.empty() && tbl_name_ != value.tbl_name_;
+            const std::string& lhs = across ? qualified_ : expr_;
+            const std::string& rhs = across ? value.qualified_ : value.expr_;
+            std::vector<pg_ormlite::param_value> params = params_;
+            params.insert(params.end(), value.params_.begin(), value.params_.end());
+            return expr (lhs + " " + op + " " + shift_placeholders(rhs, params_.size()), 
+                         qualified_ + " " + op + " " + shift_placeholders(value.qualified_, params_.size()), tbl_name_,
+                         nested_ || value.nested_, std::move(params));
+        }
+        else if constexpr (std::is_arithmetic_v<std::decay_t<T>> && !std::is_same_v<std::decay_t<T>, bool>)
+        {
+            // a json member is text, numbers compare with it as numeric
+            if (json_arrow_ != std::string::npos)
+                return expr ("(" + expr_ + ")::numeric " + op + " " + literal(value), 
+                             "(" + qualified_ + ")::numeric " + op + " " + literal(value), tbl_name_, nested_, params_);
+            return expr (expr_ + " " + op + " " + literal(value), qualified_ + " " + op + " " + literal(value), tbl_name_, nested_, params_);
+        }
+        else if constexpr (std::is_same_v<std::decay_t<T>, bool>)
+        {
+            std::string text = json_arrow_ != std::string::npos ? (value ? "'true'" : "'false'") : literal(value);
+            return expr (expr_ + " " + op + " " + text, qualified_ + " " + op + " " + text, tbl_name_, nested_, params_);
+        }
+        else if constexpr (pg_ormlite::is_time_point<std::decay_t<T>>::value)
+        {
+            // bound in binary instead of formatted into the text
+            std::vector<pg_ormlite::param_value> params = params_;
+            params.push_back(pg_ormlite::value_param(value));
+            std::string placeholder = "$" + std::to_string(params.size());
+            return expr (expr_ + " " + op + " " + placeholder, qualified_ + " " + op + " " + placeholder, tbl_name_,
+                         nested_, std::move(params));
+        }
+        else
+            return expr (expr_ + " " + op + " " + literal(value), qualified_ + " " + op + " " + literal(value), tbl_name_, nested_, params_);
+    }
+
+    // a member of a json or jsonb column as text, doc ->> 'key'. indexing the
+    // member again descends into the document, doc -> 'a' ->> 'b'
+    inline expr operator [] (std::string_view key) const
+    {
+        expr member = *this;
+        if (json_arrow_ != std::string::npos)
+        {
+            member.expr_.replace(json_arrow_, 3, "->");
+            member.qualified_.replace(json_qualified_arrow_, 3, "->");
+        }
+        member.json_arrow_ = member.expr_.size() + 1;
+        member.json_qualified_arrow_ = member.qualified_.size() + 1;
+        member.expr_ += " ->> " + literal(std::string(key));
+        member.qualified_ += " ->> " + literal(std::string(key));
+        return member;
+    }
+
+    // jsonb containment, doc @> $1, which a gin index on the column can answer
+    inline expr contains(const pg_ormlite::jsonb& document)
+    {
+        std::vector<pg_ormlite::param_value> params = params_;
+        params.push_back(pg_ormlite::value_param(document));
+        std::string placeholder = "$" + std::to_string(params.size());
+        return expr(expr_ + " @> " + placeholder, qualified_ + " @> " + placeholder, tbl_name_, nested_, std::move(params));
+    }
+
+    // membership in the rows of another query, which runs inside the same statement,
+    // or in a container of values, bound as one array parameter: the statement text
+    // is the same for any number of values. sqlite runs it as an in list.
+    template <typename T>
+    inline expr in(T&& values)
+    {
+        if constexpr (is_query<T>::value)
+        {
+            auto sql = values.to_subquery();
+            return expr(expr_ + " in " + sql, qualified_ + " in " + sql, tbl_name_, true, values.params());
+        }
+        else
+        {
+            return expr(expr_ + " = any($1)", qualified_ + " = any($1)", tbl_name_, false, {pg_ormlite::array_param(values)});
+        }
+    }
+
+    template <typename T>
+    inline expr not_in(T&& values)
+    {
+        if constexpr (is_query<T>::value)
+        {
+            auto sql = values.to_subquery();
+            return expr(expr_ + " not in " + sql, qualified_ + " not in " + sql, tbl_name_, true, values.params());
+        }
+        else
+        {
+            return expr(expr_ + " <> all($1)", qualified_ + " <> all($1)", tbl_name_, false, {pg_ormlite::array_param(values)});
+        }
     }
 
     template <typename T>
@@ -124,6 +337,12 @@ public:
         return expr_;
     }
 
+    // columns prefixed with their table, for queries over several tables
+    inline std::string qualified() const
+    {
+        return qualified_;
+    }
+
     inline std::string table_name() const
     {
         return tbl_name_;
@@ -134,55 +353,198 @@ public:
         return tbl_name_ + ", "+ expr_;
     }
 
+    // whether the expression reads other tables through a subquery
+    inline bool nested() const
+    {
+        return nested_;
+    }
+
+    // values for the $1..$n placeholders of the expression
+    inline const std::vector<pg_ormlite::param_value>& params() const
+    {
+        return params_;
+    }
+
 private:
+    template <typename Query>
+    friend expr exists(Query&& subquery);
+
+    template <typename Query>
+    friend expr not_exists(Query&& subquery);
+
+    expr(std::string&& expression, std::string&& qualified, const std::string& tbl_name, bool nested = false,
+         std::vector<pg_ormlite::param_value> params = {}) 
+    : expr_(std::move(expression)), qualified_(std::move(qualified)), tbl_name_(tbl_name), nested_(nested), 
+      params_(std::move(params)) {};
+
     std::string expr_;
+    std::string qualified_;
     std::string tbl_name_;
+    bool nested_ = false;
+    std::vector<pg_ormlite::param_value> params_;
+    // where the last ->> of a json member starts
+    std::size_t json_arrow_ = std::string::npos;
+    std::size_t json_qualified_arrow_ = std::string::npos;
+};
+
+template <typename Query>
+expr exists(Query&& subquery)
+{
+    auto sql = "exists " + subquery.to_subquery();
+    return expr(std::string(sql), std::move(sql), "", true, subquery.params());
+}
+
+template <typename Query>
+expr not_exists(Query&& subquery)
+{
+    auto sql = "not exists " + subquery.to_subquery();
+    return expr(std::string(sql), std::move(sql), "", true, subquery.params());
+}
+
+// one page of a keyset scan, next_key continues the scan with page_after
+template<typename Row, typename Key>
+struct keyset_page
+{
+    std::vector<Row> rows;
+    Key next_key{};
+    bool has_more = false;
+};
+
+// result columns taken by one element of a tuple result, a joined table spans all its fields
+template<typename U>
+constexpr std::size_t column_count()
+{
+    using V = pg_ormlite::remove_optional_t<U>;
+    if constexpr (reflection::is_reflection<V>::value)
+        return reflection::get_value<V>();
+    else
+        return 1;
+}
+
+// first result column of every tuple element, fixed at compile time
+template<typename Tuple, std::size_t... Idx>
+constexpr std::array<int, sizeof...(Idx)> column_offsets(std::index_sequence<Idx...>)
+{
+    std::array<int, sizeof...(Idx)> offsets{};
+    std::size_t counts[] = {column_count<std::tuple_element_t<Idx, Tuple>>()..., 0};
+    int offset = 0;
+    for (std::size_t i = 0; i < sizeof...(Idx); i++)
+    {
+        offsets[i] = offset;
+        offset += (int)counts[i];
+    }
+    return offsets;
+}
+
+template<typename Tuple>
+constexpr auto column_offsets()
+{
+    return column_offsets<Tuple>(std::make_index_sequence<std::tuple_size_v<Tuple>>{});
+}
+
+template<typename T>
+struct as_tuple
+{
+    using type = std::tuple<T>;
+};
+
+template<typename... Args>
+struct as_tuple<std::tuple<Args...>>
+{
+    using type = std::tuple<Args...>;
 };
 
-template <typename QueryResult>
+// whether every field name of Dto is also a field name of T
+template<typename Dto, typename T>
+constexpr bool is_projection_of()
+{
+    auto columns = reflection::get_array<T>();
+    for (auto field : reflection::get_array<Dto>())
+    {
+        bool found = false;
+        for (auto column : columns)
+        {
+            found = found || column == field;
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+template <typename QueryResult, typename Backend = pg_ormlite::pg_backend>
 class query_object
 {
 private:
-    std::string select_sql_;
-    std::string where_sql_;
-    std::string group_by_sql_;
-    std::string having_sql_;
-    std::string order_by_sql_;
+    template <typename, typename>
+    friend class query_object;
+
+    using connection_type = typename Backend::connection_type;
+
+    clause select_sql_;
+    clause where_sql_;
+    clause group_by_sql_;
+    clause having_sql_;
+    clause order_by_sql_;
     std::string limit_sql_;
     std::string offset_sql_;
     std::string delete_sql_;
     std::string update_sql_;
-    std::string set_sql_;
+    clause set_sql_;
+    // from clause of a join and exists filters of semi joins
+    clause from_sql_;
+    clause filter_sql_;
+    bool qualified_ = false;
+    // common table expressions, the relation rows are read from and whether a
+    // condition reads other tables
+    clause with_sql_;
+    std::string source_;
+    bool nested_ = false;
+    pg_ormlite::exec_options options_;
+    // keeps a pooled connection leased for as long as the query lives
+    std::shared_ptr<void> lease_;
+    std::function<void()> on_success_;
+    // values of the $n placeholders of the last statement(), in the order they appear in its text
+    std::vector<pg_ormlite::param_value> params_;
 
     std::string table_name_;
     QueryResult query_result_;
-    PGconn* conn_;
-    PGresult* res_;
+    connection_type* conn_;
+    pg_ormlite::query_cache* cache_ = nullptr;
+    // statements of the connection that were prepared ahead, they run by name
+    pg_ormlite::prepared_statements* prepared_ = nullptr;
+    // status and wire size of the last query, used to decide what the cache keeps
+    bool last_ok_ = false;
+    std::size_t last_bytes_ = 0;
     
 public:
+    using result_type = QueryResult;
 
-    query_object(PGconn* conn, std::string_view table_name) : conn_(conn), table_name_(table_name)
+    query_object(connection_type* conn, std::string_view table_name, pg_ormlite::query_cache* cache = nullptr,
+                 pg_ormlite::prepared_statements* prepared = nullptr) 
+    : table_name_(table_name), conn_(conn), cache_(cache), prepared_(prepared)
     {
 
     }
 
-    query_object(PGconn* conn, std::string_view table_name, const std::string& delete_sql, const std::string& update_sql) 
-    : conn_(conn), 
+    query_object(connection_type* conn, std::string_view table_name, const std::string& delete_sql, const std::string& update_sql,
+                 pg_ormlite::query_cache* cache = nullptr, pg_ormlite::prepared_statements* prepared = nullptr) 
+    : delete_sql_(update_sql.empty() ? delete_sql + " from " + std::string(table_name): ""),
+      update_sql_(delete_sql.empty() ? update_sql + " " + std::string(table_name): ""),
       table_name_(table_name), 
-      delete_sql_(update_sql.empty() ? delete_sql + " from " + std::string(table_name): ""),
-      update_sql_(delete_sql.empty() ? update_sql + " " + std::string(table_name): "")
+      conn_(conn), 
+      cache_(cache),
+      prepared_(prepared)
     {
 
     }
 
-    query_object(PGconn* conn, std::string_view table_name, QueryResult& query_result, 
-                 const std::string& select_sql, const std::string& where_sql, const std::string& group_by_sql, 
-                 const std::string& having_sql, const std::string& order_by_sql, const std::string& limit_sql, 
-                 const std::string& offset_sql, const std::string& delete_sql, const std::string& update_sql, const std::string& set_sql) 
-    : conn_(conn), 
-      table_name_(table_name),
-      query_result_(query_result),
-      select_sql_(select_sql),
+    query_object(connection_type* conn, std::string_view table_name, QueryResult& query_result, 
+                 const clause& select_sql, const clause& where_sql, const clause& group_by_sql, 
+                 const clause& having_sql, const clause& order_by_sql, const std::string& limit_sql, 
+                 const std::string& offset_sql, const std::string& delete_sql, const std::string& update_sql, const clause& set_sql,
+                 pg_ormlite::query_cache* cache = nullptr) 
+    : select_sql_(select_sql),
       where_sql_(where_sql),
       group_by_sql_(group_by_sql),
       having_sql_(having_sql),
@@ -191,7 +553,11 @@ public:
       offset_sql_(offset_sql),
       delete_sql_(delete_sql),
       update_sql_(update_sql),
-      set_sql_(set_sql)
+      set_sql_(set_sql),
+      table_name_(table_name),
+      query_result_(query_result),
+      conn_(conn), 
+      cache_(cache)
     {
 
     }
@@ -204,10 +570,12 @@ public:
         reflection::for_each(tp, [&](auto arg, auto i) {
             if constexpr (std::is_same_v<decltype(arg), selectable<decltype(arg.return_type)>>)
             {
-                bool same_table = arg.table_name() == table_name_;
+                // a join can select columns of every joined table
+                bool same_table = arg.table_name() == table_name_ || !from_sql_.empty();
                 assert(same_table);
-                table_name_ = arg.table_name();
-                sql += arg.to_string();
+                if (from_sql_.empty())
+                    table_name_ = arg.table_name();
+                sql += qualified_ ? arg.qualified() : arg.to_string();
                 if(i != size - 1)
                     sql += ", "; 
             }
@@ -215,12 +583,110 @@ public:
     }
 
     template<typename... Args>
-    inline query_object<std::tuple<Args...>> new_query(std::tuple<Args...>&& query_result)
+    inline query_object<std::tuple<Args...>, Backend> new_query(std::tuple<Args...>&&)
+    {
+        return rebind<std::tuple<Args...>>(select_sql_);
+    }
+
+    // the same clauses with another result type
+    template<typename R>
+    inline query_object<R, Backend> rebind(const clause& select_sql)
+    {
+        R query_result = {};
+        query_object<R, Backend> next(conn_, table_name_, query_result,  
+                                      select_sql, where_sql_, group_by_sql_, 
+                                      having_sql_, order_by_sql_, limit_sql_, 
+                                      offset_sql_, delete_sql_, update_sql_, set_sql_, cache_);
+        next.from_sql_ = from_sql_;
+        next.filter_sql_ = filter_sql_;
+        next.qualified_ = qualified_;
+        next.with_sql_ = with_sql_;
+        next.source_ = source_;
+        next.nested_ = nested_;
+        next.prepared_ = prepared_;
+        next.options_ = options_;
+        next.lease_ = lease_;
+        return next;
+    }
+
+    // the same statement with its rows decoded into another type, such as
+    // optional columns for aggregates that are null over no rows
+    template<typename R>
+    inline query_object<R, Backend> as()
+    {
+        return rebind<R>(select_sql_);
+    }
+
+    // columns of every joined table in tuple order
+    template<typename Tuple>
+    static std::string joined_columns()
+    {
+        std::string columns;
+        Tuple tp = {};
+        reflection::for_each(tp, [&columns](auto& item, auto j){
+            using U = pg_ormlite::remove_optional_t<std::decay_t<decltype(item)>>;
+            std::string table(reflection::get_name<U>());
+            for (auto field : reflection::get_array<U>())
+            {
+                columns += (columns.empty() ? "" : ", ") + table + "." + std::string(field);
+            }
+        });
+        return columns;
+    }
+
+    template<typename B, typename Element>
+    auto join_impl(const std::string& kind, const expr& on)
+    {
+        static_assert(reflection::is_reflection<B>::value, "only reflected tables can be joined");
+        using result_type = decltype(std::tuple_cat(std::declval<typename as_tuple<QueryResult>::type>(), 
+                                                    std::declval<std::tuple<Element>>()));
+        if (from_sql_.empty())
+            from_sql_ = clause(" from " + source());
+        from_sql_.append(kind + std::string(reflection::get_name<B>()) + " on (")
+                 .append(clause(on.qualified(), on.params())).append(")");
+        qualified_ = true;
+        return rebind<result_type>(clause("select " + joined_columns<result_type>()).append(from_sql_));
+    }
+
+    clause render(const expr& expression)
+    {
+        nested_ = nested_ || expression.nested();
+        return clause(qualified_ ? expression.qualified() : expression.to_string(), expression.params());
+    }
+
+    // rows read from a common table expression keep the name of the table, so
+    // qualified columns and correlated subqueries resolve against them
+    std::string source() const
+    {
+        return source_.empty() || source_ == table_name_ ? table_name_ : source_ + " as " + table_name_;
+    }
+
+public:
+    // rows of both tables for every match, decoded into std::tuple<QueryResult, B>.
+    // join before where/order_by so that their columns get qualified with the table.
+    template<typename B>
+    inline auto join(const expr& on)
     {
-        return query_object<std::tuple<Args...>>(conn_, table_name_, query_result,  
-                                                select_sql_, where_sql_, group_by_sql_, 
-                                                having_sql_, order_by_sql_, limit_sql_, 
-                                                offset_sql_, delete_sql_, update_sql_, set_sql_);
+        return join_impl<B, B>(" join ", on);
+    }
+
+    // rows without a match carry std::nullopt for B
+    template<typename B>
+    inline auto left_join(const expr& on)
+    {
+        return join_impl<B, std::optional<B>>(" left join ", on);
+    }
+
+    // keeps the rows that have a match in B without fetching B
+    template<typename B>
+    inline query_object&& semi_join(const expr& on)
+    {
+        static_assert(reflection::is_reflection<B>::value, "only reflected tables can be joined");
+        filter_sql_.append(filter_sql_.empty() ? "" : " and ")
+                   .append("exists (select 1 from " + std::string(reflection::get_name<B>()) + " where ")
+                   .append(clause(on.qualified(), on.params())).append(")");
+        qualified_ = true;
+        return std::move(*this);
     }
 
     
@@ -232,46 +698,113 @@ public:
             select_impl(sql, std::forward<Args>(args)...);
         else
             sql += " * ";
-        sql += " from " + table_name_;
-        (*this).select_sql_ = sql;
+        (*this).select_sql_ = clause(sql).append(from_sql_.empty() ? clause(" from " + source()) : from_sql_);
         return new_query(std::tuple<decltype(args.return_type)...>{});
     }
 
+    // projects into another reflected struct whose fields are matched by name to the
+    // columns of the table, only those columns are fetched and decoded
+    template<typename Dto>
+    inline query_object<Dto, Backend> select_into()
+    {
+        static_assert(reflection::is_reflection<QueryResult>::value, "select_into needs a reflected table");
+        static_assert(reflection::is_reflection<Dto>::value, "select_into needs a reflected dto");
+        static_assert(is_projection_of<Dto, QueryResult>(), "every dto field must name a column of the table");
+        std::string sql = "select ";
+        auto fields = reflection::get_array<Dto>();
+        for (std::size_t i = 0; i < fields.size(); i++)
+        {
+            sql += std::string(fields[i]);
+            if (i != fields.size() - 1)
+                sql += ", ";
+        }
+        sql += " from " + source();
+        return rebind<Dto>(clause(sql));
+    }
+
     inline query_object&& set(const expr& expression)
     {
         table_name_ = expression.table_name();
-        (*this).set_sql_ = " set " + expression.to_string();
+        (*this).set_sql_ = clause(" set ").append(clause(expression.to_string(), expression.params()));
+        return std::move(*this);
+    }
+
+    // names a query that the statement runs first, from() or a subquery can read it by name
+    template <typename Query>
+    inline query_object&& with_cte(const std::string& name, Query&& subquery)
+    {
+        std::string sql = subquery.to_subquery();
+        with_sql_.append(with_sql_.empty() ? "with " : ", ").append(name + " as ").append(clause(sql, subquery.params()));
+        nested_ = true;
+        return std::move(*this);
+    }
+
+    // reads the rows from a common table expression with the columns of the table,
+    // call it before select
+    inline query_object&& from(const std::string& relation)
+    {
+        source_ = relation;
+        nested_ = true;
         return std::move(*this);
     }
 
     inline query_object&& where(const expr& expression)
     {
-        table_name_ = expression.table_name();
-        (*this).where_sql_ = " where (" + expression.to_string() + ")";
+        if (from_sql_.empty() && !expression.table_name().empty())
+            table_name_ = expression.table_name();
+        (*this).where_sql_ = clause(" where (").append(render(expression)).append(")");
         return std::move(*this);
     }
 
     inline query_object&& group_by(const expr& expression)
     {
-        (*this).group_by_sql_ = " group by (" + expression.to_string() + ")";
+        (*this).group_by_sql_ = clause(" group by (").append(render(expression)).append(")");
         return std::move(*this);
     }
 
     inline query_object&& having(const expr& expression)
     {
-        (*this).having_sql_ = " having (" + expression.to_string() + ")";
+        (*this).having_sql_ = clause(" having (").append(render(expression)).append(")");
         return std::move(*this);
     }
 
     inline query_object&& order_by(const expr& expression)
     {
-        (*this).order_by_sql_ = " order by " + expression.to_string() + " asc";
+        (*this).order_by_sql_ = clause(" order by ").append(render(expression)).append(" asc");
         return std::move(*this);
     }
 
     inline query_object&& order_by_desc(const expr& expression)
     {
-        (*this).order_by_sql_ = " order by " + expression.to_string() + " desc";
+        (*this).order_by_sql_ = clause(" order by ").append(render(expression)).append(" desc");
+        return std::move(*this);
+    }
+
+    inline query_object&& keep_alive(std::shared_ptr<void> lease)
+    {
+        lease_ = std::move(lease);
+        return std::move(*this);
+    }
+
+    // runs after execute() has succeeded, not when it fails
+    inline query_object&& on_success(std::function<void()> hook)
+    {
+        on_success_ = std::move(hook);
+        return std::move(*this);
+    }
+
+    // a statement still running after timeout is cancelled and the query fails
+    inline query_object&& timeout(std::chrono::milliseconds timeout)
+    {
+        options_.timeout = timeout;
+        return std::move(*this);
+    }
+
+    // token.cancel() from another thread aborts the running statement,
+    // the token must outlive the query
+    inline query_object&& cancel_with(pg_ormlite::cancel_token& token)
+    {
+        options_.token = &token;
         return std::move(*this);
     }
 
@@ -287,132 +820,338 @@ public:
         return std::move(*this);
     }
     
+    // keyset pagination: the rows whose key is greater than last_key, in key order.
+    // each page is one index range scan however deep it is, unlike offset.
+    template<typename K>
+    keyset_page<QueryResult, K> page_after(const expr& key, const K& last_key, std::size_t n)
+    {
+        return fetch_page(std::vector<std::string>{key.to_string()}, clause(key.to_string() + " > $1", {pg_ormlite::value_param(last_key)}),
+                          last_key, n);
+    }
+
+    // composite keys compare as a row, (a, b) > (x, y)
+    template<typename... Exprs, typename... Ks>
+    keyset_page<QueryResult, std::tuple<Ks...>> page_after(const std::tuple<Exprs...>& keys, const std::tuple<Ks...>& last_key, std::size_t n)
+    {
+        static_assert(sizeof...(Exprs) == sizeof...(Ks), "one key value per key column");
+        auto columns = key_columns(keys);
+        std::string lhs, rhs;
+        std::vector<pg_ormlite::param_value> params;
+        std::apply([&](const auto&... item) {
+            ((lhs += (params.empty() ? "" : ", ") + columns[params.size()], params.push_back(pg_ormlite::value_param(item)),
+              rhs += (params.size() == 1 ? "$" : ", $") + std::to_string(params.size())), ...);
+        }, last_key);
+        return fetch_page(columns, clause("(" + lhs + ") > (" + rhs + ")", std::move(params)), last_key, n);
+    }
+
+    template<typename K>
+    keyset_page<QueryResult, K> first_page(const expr& key, std::size_t n)
+    {
+        return fetch_page(std::vector<std::string>{key.to_string()}, clause(), K{}, n);
+    }
+
+    template<typename... Ks, typename... Exprs>
+    keyset_page<QueryResult, std::tuple<Ks...>> first_page(const std::tuple<Exprs...>& keys, std::size_t n)
+    {
+        return fetch_page(key_columns(keys), clause(), std::tuple<Ks...>{}, n);
+    }
+
     std::string to_string()
+    {
+        return statement() + ";";
+    }
+
+    // the statement in parentheses, for in/exists/with_cte of another query
+    std::string to_subquery()
+    {
+        return "(" + statement() + ")";
+    }
+
+    // values of the $n placeholders of statement()
+    const std::vector<pg_ormlite::param_value>& params()
+    {
+        statement();
+        return params_;
+    }
+
+    const std::string& table_name() const
+    {
+        return table_name_;
+    }
+
+    std::string statement()
     {
         if (select_sql_.empty() && delete_sql_.empty() && update_sql_.empty())
         {
-            select_sql_ = "select * from " + table_name_;
+            select_sql_ = clause("select * from " + source());
         }
-        return update_sql_ + delete_sql_ + select_sql_ + set_sql_ + where_sql_ + group_by_sql_ + 
-               having_sql_ + order_by_sql_ + limit_sql_ + offset_sql_ + ";";
+        clause where_sql = where_sql_;
+        if (!filter_sql_.empty())
+            where_sql.append(where_sql.empty() ? " where " : " and ").append(filter_sql_);
+        clause sql;
+        if (!with_sql_.empty())
+            sql.append(with_sql_).append(" ");
+        sql.append(update_sql_ + delete_sql_).append(select_sql_).append(set_sql_).append(where_sql)
+           .append(group_by_sql_).append(having_sql_).append(order_by_sql_).append(limit_sql_ + offset_sql_);
+        params_ = std::move(sql.params);
+        return std::move(sql.sql);
     }
 
     template<typename T>
-    constexpr void assign_value(T&& value, int row, int col)
+    std::vector<T> query(const std::string& text)
     {
-        using U = std::remove_const_t<std::remove_reference_t<T>>;
-        if constexpr(std::is_integral<U>::value && !(std::is_same<U, int64_t>::value || std::is_same<U, uint64_t>::value))
-        {
-            // std::cout<<"smallint:"<<row<<","<<col<<std::endl;
-            value = atoi(PQgetvalue(res_, row, col));
-        }
-        else if constexpr(std::is_enum_v<U>)
+        std::vector<T> ret_vector;
+        const std::string& sql = Backend::expand_arrays(text, params_);
+        pg_ormlite::log_trace("query:", sql);
+        auto start = pg_ormlite::slow_query_log::instance().start();
+        typename Backend::statement stmt(conn_, sql);
+        bind_params(stmt);
+        use_prepared(stmt, sql);
+        auto cursor = stmt.step(options_);
+        last_ok_ = cursor.ok();
+        if (!last_ok_) 
         {
-            value = static_cast<U>(atoi(PQgetvalue(res_, row, col)));
+            pg_ormlite::log_error(cursor.error());
+            record(start, sql, 0, false);
+            return ret_vector;
         }
-        else if constexpr(std::is_floating_point<U>::value)
+        ret_vector = collect<T>(cursor);
+        last_ok_ = cursor.ok();
+        last_bytes_ = cursor.bytes();
+        record(start, sql, ret_vector.size(), last_ok_);
+        return ret_vector;
+    }
+
+    // the rows of a cursor over the statement of this query, also used for
+    // statements that were sent together in a batch
+    template<typename T = QueryResult, typename Cursor>
+    static std::vector<T> collect(Cursor& cursor)
+    {
+        std::vector<T> ret_vector;
+        while (cursor.next())
         {
-            // std::cout<<"float:"<<row<<","<<col<<std::endl;
-            value = atof(PQgetvalue(res_, row, col));
+            T tp = {};
+            if constexpr (reflection::is_reflection<T>::value)
+                cursor.get_row(tp);
+            else
+                read_tuple(cursor, tp);
+            ret_vector.push_back(std::move(tp));
         }
-        else if constexpr(std::is_same<U, int64_t>::value || std::is_same<U, uint64_t>::value)
+        return ret_vector;
+    }
+
+    std::vector<QueryResult> to_vector()
+    {
+        auto sql = to_string();
+        // invalidation is per table, results that read other tables are not cached
+        if (cache_ == nullptr || !delete_sql_.empty() || !update_sql_.empty() || !from_sql_.empty() || !filter_sql_.empty() || nested_)
+            return query<QueryResult>(sql);
+        // a hit never reaches the loader, only successful results are cached
+        last_ok_ = true;
+        return cache_->get_or_load<QueryResult>(table_name_, cache_key(sql), [this, &sql](bool& ok, std::size_t& bytes) {
+            auto ret_vector = query<QueryResult>(sql);
+            ok = last_ok_;
+            bytes = last_bytes_;
+            return ret_vector;
+        });
+    }
+
+    bool execute()
+    {
+        auto text = to_string();
+        const std::string& sql = Backend::expand_arrays(text, params_);
+        pg_ormlite::log_trace("exec:", sql);
+        auto start = pg_ormlite::slow_query_log::instance().start();
+        typename Backend::statement stmt(conn_, sql);
+        bind_params(stmt);
+        use_prepared(stmt, sql);
+        auto cursor = stmt.step(options_);
+        bool ok = cursor.ok();
+        if (!ok)
+            pg_ormlite::log_error(cursor.error());
+        record(start, sql, cursor.affected(), ok);
+        if (ok && cache_ != nullptr && (!delete_sql_.empty() || !update_sql_.empty()))
+            cache_->invalidate(table_name_);
+        if (ok && on_success_)
+            on_success_();
+        return ok;
+        // return true;
+    }
+
+    // analyze runs the statement, an update or delete is rolled back afterwards
+    pg_ormlite::query_plan explain(bool analyze = false, bool buffers = false)
+    {
+        bool modifies = !delete_sql_.empty() || !update_sql_.empty();
+        std::string sql = std::string("explain (format json") + (analyze ? ", analyze" : "") + 
+                          (buffers ? ", buffers" : "") + ") " + to_string();
+        pg_ormlite::log_trace("explain:", sql);
+        if (analyze && modifies)
+            typename Backend::statement(conn_, "begin;").step();
+        pg_ormlite::query_plan plan;
         {
-            // std::cout<<"bigint:"<<row<<","<<col<<std::endl;
-            value = atoll(PQgetvalue(res_, row, col));
+            typename Backend::statement stmt(conn_, sql);
+            bind_params(stmt);
+            auto cursor = stmt.step(options_);
+            std::string text;
+            if (cursor.ok() && cursor.next())
+            {
+                cursor.get(0, text);
+                plan = pg_ormlite::parse_plan(text.data());
+            }
+            else
+            {
+                pg_ormlite::log_error(cursor.error());
+            }
         }
-        else if constexpr(std::is_same<U, std::string>::value)
+        if (analyze && modifies)
+            typename Backend::statement(conn_, "rollback;").step();
+        return plan;
+    }
+
+    // whether the last to_vector() succeeded, an empty result alone is ambiguous
+    bool ok() const
+    {
+        return last_ok_;
+    }
+
+private:
+    template<typename... Exprs>
+    static std::vector<std::string> key_columns(const std::tuple<Exprs...>& keys)
+    {
+        std::vector<std::string> columns;
+        std::apply([&columns](const auto&... item) {
+            (columns.push_back(item.to_string()), ...);
+        }, keys);
+        return columns;
+    }
+
+    template<typename K>
+    keyset_page<QueryResult, K> fetch_page(const std::vector<std::string>& columns, const clause& after, const K& last_key, std::size_t n)
+    {
+        static_assert(reflection::is_reflection<QueryResult>::value, "keyset pagination needs a reflected row type");
+        // the page runs on a copy, the query can fetch any number of pages
+        query_object next = *this;
+        if (!after.empty())
+            next.where_sql_.append(where_sql_.empty() ? " where (" : " and (").append(after).append(")");
+        next.order_by_sql_ = clause(" order by ");
+        for (std::size_t i = 0; i < columns.size(); i++)
         {
-            // std::cout<<"string:"<<row<<","<<col<<std::endl;
-            value = PQgetvalue(res_, row, col);
+            next.order_by_sql_.append((i == 0 ? "" : ", ") + columns[i] + " asc");
         }
-        else if constexpr(std::is_array<U>::value && std::is_same<char, std::remove_pointer_t<std::decay_t<U>>>::value)
+        // one extra row tells whether another page follows
+        next.limit_sql_ = " limit " + std::to_string(n + 1);
+        next.offset_sql_.clear();
+
+        keyset_page<QueryResult, K> page;
+        page.rows = next.to_vector();
+        last_ok_ = next.last_ok_;
+        last_bytes_ = next.last_bytes_;
+        page.has_more = page.rows.size() > n;
+        if (page.has_more)
+            page.rows.pop_back();
+        page.next_key = last_key;
+        if (page.rows.empty())
+            return page;
+        if constexpr (traits_utils::is_tuple<K>::value)
         {
-            // std::cout<<"array:"<<row<<","<<col<<std::endl;
-            auto ptr = PQgetvalue(res_, row, col);
-            memcpy(value, ptr, sizeof(U));
+            reflection::for_each(page.next_key, [&](auto& item, auto j){
+                read_column(page.rows.back(), columns[j], item);
+            });
         }
         else
         {
-            std::cout<<"unsupported type:" << std::is_array<U>::value<<std::endl;
+            read_column(page.rows.back(), columns[0], page.next_key);
         }
+        return page;
     }
 
-    template<typename T>
-    constexpr std::enable_if_t<reflection::is_reflection<T>::value, std::vector<T>> query(const std::string& sql)
+    template<typename V>
+    static void read_column(const QueryResult& row, const std::string& column, V& out)
     {
-        std::vector<T> ret_vector;
-        std::cout<<"query:"<<sql<<std::endl;
-        res_ = PQexec(conn_, sql.c_str());
-        if (PQresultStatus(res_) != PGRES_TUPLES_OK) 
-        {
-            std::cout << PQresultErrorMessage(res_) << std::endl;
-            PQclear(res_);
-            return ret_vector;
-        }
-        // std::cout<<"num:"<<PQntuples(res_)<<std::endl;
-        auto ntuples = PQntuples(res_);
-        for (size_t i = 0; i < ntuples; i++)
-        {
-            T tp = {};
-            reflection::for_each(tp, [this, &tp, &i](auto item, auto field, auto j){
-                assign_value(tp.*item, i, (int)decltype(j)::value);
-            });
-            ret_vector.push_back(std::move(tp));
-        }
-        PQclear(res_);
-        return ret_vector;
+        reflection::for_each(row, [&](auto item, auto field, auto j){
+            using U = std::remove_const_t<std::remove_reference_t<decltype(row.*item)>>;
+            if (field != column)
+                return;
+            if constexpr (std::is_array_v<U> && std::is_same_v<V, std::string>)
+                out = std::string(row.*item, strnlen(row.*item, sizeof(U)));
+            else if constexpr (std::is_assignable_v<V&, const U&>)
+                out = row.*item;
+        });
     }
-    
-    template<typename T>
-    constexpr std::enable_if_t<!reflection::is_reflection<T>::value, std::vector<T>> query(const std::string& sql)
+
+private:
+    template<typename Cursor, typename T>
+    static void read_tuple(const Cursor& cursor, T& tp)
     {
-        std::vector<T> ret_vector;
-        std::cout<<"query:"<<sql<<std::endl;
-        res_ = PQexec(conn_, sql.c_str());
-        if (PQresultStatus(res_) != PGRES_TUPLES_OK) 
-        {
-            std::cout << PQresultErrorMessage(res_) << std::endl;
-            PQclear(res_);
-            return ret_vector;
-        }
-        // std::cout<<"num:"<<PQntuples(res_)<<std::endl;
-        auto ntuples = PQntuples(res_);
-        for (size_t i = 0; i < ntuples; i++)
-        {
-            T tp = {};
-            int index = 0;
-            reflection::for_each(tp, [this, &i, &index](auto& item, auto j){
-                if constexpr(reflection::is_reflection_v<std::decay_t<decltype(item)>>)
+        constexpr auto offsets = column_offsets<T>();
+        reflection::for_each(tp, [&cursor, &offsets](auto& item, auto j){
+            using U = std::decay_t<decltype(item)>;
+            int col = offsets[decltype(j)::value];
+            if constexpr(reflection::is_reflection_v<U>)
+            {
+                cursor.get_row(item, col);
+            }
+            else if constexpr(pg_ormlite::is_optional<U>::value && reflection::is_reflection_v<pg_ormlite::remove_optional_t<U>>)
+            {
+                // an unmatched left join leaves every column of the table null
+                bool matched = false;
+                for (int i = 0; i < (int)column_count<U>(); i++)
                 {
-                    std::decay_t<decltype(item)> t = {};
-                    reflection::for_each(t, [this, &index, &t](auto ele, auto field, auto j){
-                        assign_value(t.*ele, j, index++);
-                    });
-                    item = std::move(t);
+                    matched = matched || !cursor.is_null(col + i);
                 }
+                if (matched)
+                    cursor.get_row(item.emplace(), col);
                 else
-                {
-                    assign_value(item, (int)i, index++);
-                }
-            });
-            ret_vector.push_back(tp);
+                    item.reset();
+            }
+            else
+            {
+                cursor.get(col, item);
+            }
+        });
+    }
+
+    template<typename Statement>
+    void use_prepared(Statement& stmt, const std::string& sql) const
+    {
+        if (prepared_ == nullptr)
+            return;
+        std::vector<Oid> types;
+        for (auto& param : params_)
+        {
+            types.push_back(param.type);
         }
-        PQclear(res_);
-        return ret_vector;
+        if (auto name = prepared_->find(sql, types))
+            stmt.prepared(*name);
     }
 
-    std::vector<QueryResult> to_vector()
+    template<typename Statement>
+    void bind_params(Statement& stmt) const
     {
-        return query<QueryResult>(to_string());
+        for (std::size_t i = 0; i < params_.size(); i++)
+        {
+            stmt.bind_param((int)i + 1, params_[i]);
+        }
     }
 
-    bool execute()
+    // the same text with other parameter values is another result, the cache adds the row type
+    std::string cache_key(const std::string& sql) const
     {
-        auto sql = to_string();
-        std::cout<<"exec:"<<sql<<std::endl;
-        res_ = PQexec(conn_, sql.data());
-        return PQresultStatus(res_) == PGRES_COMMAND_OK;
-        // return true;
+        std::string key = sql;
+        for (auto& param : params_)
+        {
+            key += '\0' + std::to_string(param.data.size()) + ':';
+            key.append(param.data.begin(), param.data.end());
+        }
+        return key;
+    }
+
+    void record(std::chrono::steady_clock::time_point start, const std::string& sql, long rows, bool ok)
+    {
+        if (start == std::chrono::steady_clock::time_point{})
+            return;
+        pg_ormlite::param_buffers buffers(params_);
+        pg_ormlite::slow_query_log::instance().finish(start, table_name_, sql, rows, ok, buffers.printable());
     }
 
 
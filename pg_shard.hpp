@@ -0,0 +1,556 @@
+#ifndef PG_SHARD_HPP
+#define PG_SHARD_HPP
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include "pg_pool.hpp"
+
+namespace pg_ormlite
+{
+
+// fnv-1a with a murmur finalizer, stable across processes unlike std::hash
+inline std::uint64_t shard_hash(const char* data, std::size_t size)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb93fe53a4ce3ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// a key hashes by its value on the wire, so 42, 42L and std::string("42") meet on one shard.
+// text values end with a nul that is not hashed, binary values are hashed whole.
+template<typename K>
+std::uint64_t shard_hash(const K& key)
+{
+    std::vector<char> data;
+    codec<K>::encode(key, data);
+    bool text = codec<K>::format() == 0;
+    return shard_hash(data.data(), text && !data.empty() ? data.size() - 1 : data.size());
+}
+
+// -1, 0 or 1, char arrays compare as text
+template<typename U>
+int compare_values(const U& a, const U& b)
+{
+    if constexpr (std::is_array_v<U>)
+        return strncmp(a, b, sizeof(U));
+    else
+        return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// compares two rows by the field named column, rows without it compare equal
+template<typename T>
+int compare_column(const T& a, const T& b, const std::string& column)
+{
+    int result = 0;
+    reflection::for_each(a, [&](auto item, auto field, auto j){
+        if (field == column)
+            result = compare_values(a.*item, b.*item);
+    });
+    return result;
+}
+
+// runs every query on its own thread, ok is cleared when any of them fails
+template<typename Query>
+auto fan_out(std::vector<Query>& queries, bool& ok)
+{
+    using rows_type = decltype(queries[0].to_vector());
+    std::vector<std::future<rows_type>> pending;
+    for (auto& q : queries)
+    {
+        pending.push_back(std::async(std::launch::async, [&q]() { return q.to_vector(); }));
+    }
+    std::vector<rows_type> parts;
+    for (auto& f : pending)
+    {
+        parts.push_back(f.get());
+    }
+    ok = std::all_of(queries.begin(), queries.end(), [](const Query& q) { return q.ok(); });
+    return parts;
+}
+
+// aggregates of a query over every shard, each shard aggregates its own rows and the
+// partial results are combined here. a shard without rows returns null partials,
+// which is why the shards decode into optionals.
+template<typename Backend, typename... Rs>
+class sharded_aggregate
+{
+public:
+    using row_type = std::tuple<Rs...>;
+    using partial_type = std::tuple<std::optional<Rs>...>;
+    using shard_query = pg_query_object::query_object<partial_type, Backend>;
+
+    sharded_aggregate(std::vector<shard_query>&& shards, std::vector<std::string>&& ops, std::vector<std::string>&& columns)
+    : shards_(std::move(shards)), ops_(std::move(ops)), columns_(std::move(columns))
+    {
+
+    }
+
+    inline sharded_aggregate&& where(const pg_query_object::expr& expression)
+    {
+        for (auto& q : shards_)
+        {
+            q.where(expression);
+        }
+        return std::move(*this);
+    }
+
+    // partial groups of the shards are combined by their plain columns
+    inline sharded_aggregate&& group_by(const pg_query_object::expr& expression)
+    {
+        for (auto& q : shards_)
+        {
+            q.group_by(expression);
+        }
+        return std::move(*this);
+    }
+
+    // ordering and limits apply to the combined groups, one of the selected plain columns orders them
+    inline sharded_aggregate&& order_by(const pg_query_object::expr& expression)
+    {
+        // matched against the selected columns, where a plain column renders as (field)
+        order_column_ = "(" + expression.to_string() + ")";
+        descending_ = false;
+        return std::move(*this);
+    }
+
+    inline sharded_aggregate&& order_by_desc(const pg_query_object::expr& expression)
+    {
+        order_column_ = "(" + expression.to_string() + ")";
+        descending_ = true;
+        return std::move(*this);
+    }
+
+    inline sharded_aggregate&& limit(std::size_t n)
+    {
+        limit_ = n;
+        return std::move(*this);
+    }
+
+    inline sharded_aggregate&& offset(std::size_t n)
+    {
+        offset_ = n;
+        return std::move(*this);
+    }
+
+    inline sharded_aggregate&& timeout(std::chrono::milliseconds timeout)
+    {
+        for (auto& q : shards_)
+        {
+            q.timeout(timeout);
+        }
+        return std::move(*this);
+    }
+
+    std::vector<row_type> to_vector()
+    {
+        std::vector<row_type> rows;
+        if (std::find(ops_.begin(), ops_.end(), "avg") != ops_.end())
+        {
+            log_error("avg cannot be combined across shards, select sum and count instead");
+            ok_ = false;
+            return rows;
+        }
+        auto parts = fan_out(shards_, ok_);
+        bool aggregated = std::any_of(ops_.begin(), ops_.end(), [](const std::string& op) { return !op.empty(); });
+        std::vector<partial_type> merged;
+        std::unordered_map<std::string, std::size_t> groups;
+        for (auto& part : parts)
+        {
+            for (auto& partial : part)
+            {
+                if (!aggregated)
+                {
+                    merged.push_back(std::move(partial));
+                    continue;
+                }
+                auto found = groups.emplace(group_key(partial, std::index_sequence_for<Rs...>{}), merged.size());
+                if (found.second)
+                    merged.push_back(std::move(partial));
+                else
+                    combine(merged[found.first->second], partial, std::index_sequence_for<Rs...>{});
+            }
+        }
+
+        auto column = std::find(columns_.begin(), columns_.end(), order_column_);
+        if (!order_column_.empty() && column != columns_.end())
+        {
+            std::size_t index = column - columns_.begin();
+            std::stable_sort(merged.begin(), merged.end(), [this, index](const partial_type& a, const partial_type& b) {
+                int c = compare_at(a, b, index, std::index_sequence_for<Rs...>{});
+                return descending_ ? c > 0 : c < 0;
+            });
+        }
+        std::size_t begin = std::min(offset_, merged.size());
+        std::size_t end = limit_.has_value() ? std::min(merged.size(), begin + *limit_) : merged.size();
+        for (std::size_t i = begin; i < end; i++)
+        {
+            rows.push_back(std::apply([](auto&... value) { return row_type(value.value_or(Rs{})...); }, merged[i]));
+        }
+        return rows;
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+private:
+    template<std::size_t... Idx>
+    std::string group_key(const partial_type& row, std::index_sequence<Idx...>) const
+    {
+        std::vector<char> text;
+        auto append = [&text](const auto& value) {
+            // a null is a lone marker byte, every value ends with a nul
+            if (!codec<std::decay_t<decltype(value)>>::encode(value, text))
+                text.push_back('\1');
+        };
+        ((ops_[Idx].empty() ? append(std::get<Idx>(row)) : void()), ...);
+        return std::string(text.begin(), text.end());
+    }
+
+    template<std::size_t... Idx>
+    void combine(partial_type& acc, const partial_type& row, std::index_sequence<Idx...>) const
+    {
+        (combine_value(std::get<Idx>(acc), std::get<Idx>(row), ops_[Idx]), ...);
+    }
+
+    template<typename U>
+    static void combine_value(std::optional<U>& acc, const std::optional<U>& value, const std::string& op)
+    {
+        if (!value.has_value() || op.empty())
+            return;
+        if (!acc.has_value())
+            acc = value;
+        else if (op == "max" && compare_values(*acc, *value) < 0)
+            acc = value;
+        else if (op == "min" && compare_values(*value, *acc) < 0)
+            acc = value;
+        else if constexpr (std::is_arithmetic_v<U>)
+        {
+            if (op == "sum" || op == "count")
+                *acc += *value;
+        }
+    }
+
+    template<std::size_t... Idx>
+    static int compare_at(const partial_type& a, const partial_type& b, std::size_t index, std::index_sequence<Idx...>)
+    {
+        int result = 0;
+        ((Idx == index ? void(result = compare_values(std::get<Idx>(a), std::get<Idx>(b))) : void()), ...);
+        return result;
+    }
+
+    std::vector<shard_query> shards_;
+    std::vector<std::string> ops_;
+    std::vector<std::string> columns_;
+    std::string order_column_;
+    bool descending_ = false;
+    std::optional<std::size_t> limit_;
+    std::size_t offset_ = 0;
+    bool ok_ = false;
+};
+
+// rows of a query over every shard. with order_by the sorted shard results are
+// merged k ways, and a limit asks every shard for no more than offset + limit rows.
+template<typename T, typename Backend = pg_backend>
+class sharded_query
+{
+public:
+    using shard_query = pg_query_object::query_object<T, Backend>;
+
+    explicit sharded_query(std::vector<shard_query>&& shards) : shards_(std::move(shards))
+    {
+
+    }
+
+    inline sharded_query&& where(const pg_query_object::expr& expression)
+    {
+        for (auto& q : shards_)
+        {
+            q.where(expression);
+        }
+        return std::move(*this);
+    }
+
+    inline sharded_query&& order_by(const pg_query_object::expr& expression)
+    {
+        for (auto& q : shards_)
+        {
+            q.order_by(expression);
+        }
+        order_column_ = expression.to_string();
+        descending_ = false;
+        return std::move(*this);
+    }
+
+    inline sharded_query&& order_by_desc(const pg_query_object::expr& expression)
+    {
+        for (auto& q : shards_)
+        {
+            q.order_by_desc(expression);
+        }
+        order_column_ = expression.to_string();
+        descending_ = true;
+        return std::move(*this);
+    }
+
+    inline sharded_query&& limit(std::size_t n)
+    {
+        limit_ = n;
+        return std::move(*this);
+    }
+
+    inline sharded_query&& offset(std::size_t n)
+    {
+        offset_ = n;
+        return std::move(*this);
+    }
+
+    inline sharded_query&& timeout(std::chrono::milliseconds timeout)
+    {
+        for (auto& q : shards_)
+        {
+            q.timeout(timeout);
+        }
+        return std::move(*this);
+    }
+
+    // ORM_SUM, ORM_COUNT, ORM_MAX, ORM_MIN and plain columns, call it before where
+    template<typename... Args>
+    inline auto select(Args&&... args)
+    {
+        using aggregate_type = sharded_aggregate<Backend, decltype(args.return_type)...>;
+        std::vector<typename aggregate_type::shard_query> shards;
+        for (auto& q : shards_)
+        {
+            shards.push_back(q.select(args...).template as<typename aggregate_type::partial_type>());
+        }
+        return aggregate_type(std::move(shards), {args.op()...}, {args.to_string()...});
+    }
+
+    std::vector<T> to_vector()
+    {
+        std::size_t wanted = limit_.has_value() ? offset_ + *limit_ : std::numeric_limits<std::size_t>::max();
+        if (limit_.has_value())
+        {
+            for (auto& q : shards_)
+            {
+                q.limit(wanted);
+            }
+        }
+        auto parts = fan_out(shards_, ok_);
+        std::vector<T> rows;
+        if (order_column_.empty())
+        {
+            for (auto& part : parts)
+            {
+                for (auto& row : part)
+                {
+                    if (rows.size() == wanted)
+                        break;
+                    rows.push_back(std::move(row));
+                }
+            }
+        }
+        else
+        {
+            // shard and position of the next row of every shard, ties go to the lower shard
+            using head = std::pair<std::size_t, std::size_t>;
+            auto later = [this, &parts](const head& a, const head& b) {
+                int c = compare_column(parts[a.first][a.second], parts[b.first][b.second], order_column_);
+                if (descending_)
+                    c = -c;
+                return c != 0 ? c > 0 : a.first > b.first;
+            };
+            std::priority_queue<head, std::vector<head>, decltype(later)> heads(later);
+            for (std::size_t i = 0; i < parts.size(); i++)
+            {
+                if (!parts[i].empty())
+                    heads.emplace(i, 0);
+            }
+            while (!heads.empty() && rows.size() < wanted)
+            {
+                head next = heads.top();
+                heads.pop();
+                rows.push_back(std::move(parts[next.first][next.second]));
+                if (next.second + 1 < parts[next.first].size())
+                    heads.emplace(next.first, next.second + 1);
+            }
+        }
+        rows.erase(rows.begin(), rows.begin() + std::min(offset_, rows.size()));
+        return rows;
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+private:
+    std::vector<shard_query> shards_;
+    std::string order_column_;
+    bool descending_ = false;
+    std::optional<std::size_t> limit_;
+    std::size_t offset_ = 0;
+    bool ok_ = false;
+};
+
+// one table spread over several servers by consistent hashing of its key field.
+// rows with the same key always live on the same shard, and adding a shard moves
+// only about 1/n of the keys.
+template<typename T>
+class sharded_connection
+{
+public:
+    sharded_connection(std::vector<std::shared_ptr<connection_pool>> shards, const key_map& key, std::size_t virtual_nodes = 128)
+    : shards_(std::move(shards)), key_(key.fields)
+    {
+        assert(!shards_.empty());
+        auto fields = reflection::get_array<T>();
+        assert(std::find(fields.begin(), fields.end(), key_) != fields.end());
+        for (std::size_t i = 0; i < shards_.size(); i++)
+        {
+            for (std::size_t v = 0; v < virtual_nodes; v++)
+            {
+                std::string label = std::to_string(i) + "#" + std::to_string(v);
+                ring_.emplace_back(shard_hash(label.data(), label.size()), i);
+            }
+        }
+        std::sort(ring_.begin(), ring_.end());
+    }
+
+    template<typename K>
+    std::size_t shard_of_key(const K& key) const
+    {
+        std::uint64_t h = shard_hash(key);
+        auto node = std::lower_bound(ring_.begin(), ring_.end(), h, [](const auto& node, std::uint64_t value) {
+            return node.first < value;
+        });
+        return node == ring_.end() ? ring_.front().second : node->second;
+    }
+
+    std::size_t shard_of(const T& row) const
+    {
+        std::size_t shard = 0;
+        reflection::for_each(row, [&](auto item, auto field, auto j){
+            if (field == key_)
+                shard = shard_of_key(row.*item);
+        });
+        return shard;
+    }
+
+    std::size_t shard_count() const
+    {
+        return shards_.size();
+    }
+
+    template<typename... Args>
+    bool create_table(Args&&... args)
+    {
+        bool ok = true;
+        for (auto& pool : shards_)
+        {
+            ok = pool->acquire()->template create_table<T>(args...) && ok;
+        }
+        return ok;
+    }
+
+    // runs on every shard
+    bool execute(const std::string& sql)
+    {
+        bool ok = true;
+        for (auto& pool : shards_)
+        {
+            ok = pool->acquire()->execute(sql) && ok;
+        }
+        return ok;
+    }
+
+    int insert(const T& t)
+    {
+        return shards_[shard_of(t)]->acquire()->insert(t);
+    }
+
+    // one bulk insert per shard in parallel. shards commit independently, the
+    // count only includes the rows of shards that succeeded.
+    int bulk_insert(const std::vector<T>& t)
+    {
+        std::vector<std::vector<T>> parts(shards_.size());
+        for (auto& row : t)
+        {
+            parts[shard_of(row)].push_back(row);
+        }
+        std::vector<std::future<int>> pending;
+        for (std::size_t i = 0; i < shards_.size(); i++)
+        {
+            if (!parts[i].empty())
+                pending.push_back(std::async(std::launch::async, [this, &parts, i]() {
+                    return shards_[i]->acquire()->bulk_insert(parts[i]);
+                }));
+        }
+        int rows = 0;
+        for (auto& f : pending)
+        {
+            rows += f.get();
+        }
+        return rows;
+    }
+
+    // every shard in parallel
+    sharded_query<T> query()
+    {
+        std::vector<pg_query_object::query_object<T>> queries;
+        for (auto& pool : shards_)
+        {
+            auto lease = pool->acquire();
+            queries.push_back(lease->template query<T>().keep_alive(lease));
+        }
+        return sharded_query<T>(std::move(queries));
+    }
+
+    // the shard that owns key, where() should still filter on the key
+    template<typename K>
+    auto query(const K& key)
+    {
+        auto lease = shards_[shard_of_key(key)]->acquire();
+        return lease->template query<T>().keep_alive(lease);
+    }
+
+    template<typename K>
+    auto update(const K& key)
+    {
+        auto lease = shards_[shard_of_key(key)]->acquire();
+        return lease->template update<T>().keep_alive(lease);
+    }
+
+    template<typename K>
+    auto del(const K& key)
+    {
+        auto lease = shards_[shard_of_key(key)]->acquire();
+        return lease->template del<T>().keep_alive(lease);
+    }
+
+private:
+    std::vector<std::shared_ptr<connection_pool>> shards_;
+    std::string key_;
+    // virtual nodes sorted by position, a key belongs to the first node at or after its hash
+    std::vector<std::pair<std::uint64_t, std::size_t>> ring_;
+};
+
+}
+
+#endif
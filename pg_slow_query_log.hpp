@@ -0,0 +1,186 @@
+#ifndef PG_SLOW_QUERY_LOG_HPP
+#define PG_SLOW_QUERY_LOG_HPP
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <ostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "concurrent_utils.hpp"
+
+namespace pg_ormlite
+{
+
+struct slow_query_record
+{
+    // reflected type or table the statement was issued for
+    std::string type_name;
+    // statement with every literal replaced by ?
+    std::string statement;
+    // bound parameters, reduced to their length unless capture_params is on
+    std::vector<std::string> params;
+    long rows = 0;
+    bool ok = false;
+    // recorded by sampling rather than by the latency threshold
+    bool sampled = false;
+    std::chrono::microseconds duration{0};
+    std::chrono::system_clock::time_point at;
+};
+
+// process wide recorder used by query_object::query/execute and pg_connection inserts.
+// disabled until configured, then it costs two clock reads per statement.
+class slow_query_log
+{
+public:
+    static constexpr std::size_t capacity = 4096;
+
+    static slow_query_log& instance()
+    {
+        static slow_query_log log;
+        return log;
+    }
+
+    // records every statement slower than threshold plus a sample_rate share of the rest,
+    // a zero threshold with a zero sample rate disables recording
+    void configure(std::chrono::microseconds threshold, double sample_rate = 0, bool capture_params = false)
+    {
+        threshold_us_.store(threshold.count(), std::memory_order_relaxed);
+        sample_rate_.store(sample_rate, std::memory_order_relaxed);
+        capture_params_.store(capture_params, std::memory_order_relaxed);
+        enabled_.store(threshold.count() > 0 || sample_rate > 0, std::memory_order_release);
+    }
+
+    bool enabled() const
+    {
+        return enabled_.load(std::memory_order_acquire);
+    }
+
+    std::chrono::steady_clock::time_point start() const
+    {
+        return enabled() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+    }
+
+    void finish(std::chrono::steady_clock::time_point start, std::string_view type_name, std::string_view sql,
+                long rows, bool ok, const std::vector<const char*>& params = {})
+    {
+        if (start == std::chrono::steady_clock::time_point{})
+            return;
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        bool slow = threshold_us_.load(std::memory_order_relaxed) > 0 &&
+                    duration.count() >= threshold_us_.load(std::memory_order_relaxed);
+        bool sampled = !slow && sample();
+        if (!slow && !sampled)
+            return;
+
+        slow_query_record record;
+        record.type_name = std::string(type_name);
+        record.statement = normalize(sql);
+        bool capture = capture_params_.load(std::memory_order_relaxed);
+        for (auto param : params)
+        {
+            std::string value = param == nullptr ? "null" : param;
+            if (capture)
+                record.params.push_back(value.size() > 64 ? value.substr(0, 64) + "..." : value);
+            else
+                record.params.push_back("<" + std::to_string(value.size()) + " bytes>");
+        }
+        record.rows = rows;
+        record.ok = ok;
+        record.sampled = sampled;
+        record.duration = duration;
+        record.at = std::chrono::system_clock::now();
+
+        // the oldest record makes room when the buffer is full
+        for (int attempt = 0; attempt < 4 && !records_.try_push(std::move(record)); attempt++)
+        {
+            slow_query_record dropped;
+            records_.try_pop(dropped);
+        }
+    }
+
+    // removes and returns everything recorded so far, oldest first
+    std::vector<slow_query_record> drain()
+    {
+        std::vector<slow_query_record> ret_vector;
+        slow_query_record record;
+        while (records_.try_pop(record))
+        {
+            ret_vector.push_back(std::move(record));
+        }
+        return ret_vector;
+    }
+
+    void dump(std::ostream& os)
+    {
+        for (auto& record : drain())
+        {
+            os << record.duration.count() << "us " << (record.sampled ? "sampled " : "slow ")
+               << record.type_name << " rows=" << record.rows << (record.ok ? " " : " failed ") << record.statement;
+            for (std::size_t i = 0; i < record.params.size(); i++)
+            {
+                os << (i == 0 ? " params:" : ", ") << record.params[i];
+            }
+            os << "\n";
+        }
+    }
+
+    // replaces quoted strings and numeric literals with ?, keeps $n placeholders
+    static std::string normalize(std::string_view sql)
+    {
+        std::string shape;
+        shape.reserve(sql.size());
+        for (std::size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (c == '\'')
+            {
+                i++;
+                while (i < sql.size() && !(sql[i] == '\'' && (i + 1 >= sql.size() || sql[i + 1] != '\'')))
+                {
+                    i += sql[i] == '\'' ? 2 : 1;
+                }
+                shape += '?';
+            }
+            else if (isdigit((unsigned char)c) && (i == 0 || !(isalnum((unsigned char)sql[i - 1]) || sql[i - 1] == '_' || sql[i - 1] == '$')))
+            {
+                while (i + 1 < sql.size() && (isdigit((unsigned char)sql[i + 1]) || sql[i + 1] == '.'))
+                {
+                    i++;
+                }
+                shape += '?';
+            }
+            else
+            {
+                shape += c;
+            }
+        }
+        return shape;
+    }
+
+private:
+    slow_query_log() : records_(capacity)
+    {
+
+    }
+
+    bool sample() const
+    {
+        double rate = sample_rate_.load(std::memory_order_relaxed);
+        if (rate <= 0)
+            return false;
+        thread_local std::minstd_rand engine(std::random_device{}());
+        return std::uniform_real_distribution<double>(0, 1)(engine) < rate;
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<long long> threshold_us_{0};
+    std::atomic<double> sample_rate_{0};
+    std::atomic<bool> capture_params_{false};
+    concurrent_utils::ring_buffer<slow_query_record> records_;
+};
+
+}
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef PG_SNAPSHOT_HPP
+#define PG_SNAPSHOT_HPP
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+// file layout: header | row_count fixed-width rows | string heap.
+// scalars, enums and char[N] are stored in place, std::string as (offset, length) into the heap.
+struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t row_width;
+    uint64_t schema_hash;
+    uint64_t row_count;
+    uint64_t rows_offset;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+};
+
+constexpr uint32_t snapshot_version = 1;
+constexpr char snapshot_magic[8] = {'O', 'R', 'M', 'S', 'N', 'A', 'P', '\0'};
+
+template<typename U>
+constexpr std::size_t snapshot_field_width()
+{
+    if constexpr (std::is_same_v<U, std::string>)
+        return sizeof(uint64_t) + sizeof(uint32_t);
+    else
+    {
+        static_assert(std::is_trivially_copyable_v<U>, "unsupported snapshot field type");
+        return sizeof(U);
+    }
+}
+
+template<typename Tuple, std::size_t... Idx>
+constexpr std::size_t snapshot_row_width(std::index_sequence<Idx...>)
+{
+    return (snapshot_field_width<typename pg_query_object::field_attribute<std::tuple_element_t<Idx, Tuple>>::return_type>() + ...);
+}
+
+template<typename T>
+constexpr std::size_t snapshot_row_width()
+{
+    using Tuple = decltype(reflection::Reflect_members<T>::apply_impl());
+    return snapshot_row_width<Tuple>(std::make_index_sequence<std::tuple_size_v<Tuple>>{});
+}
+
+// changes whenever the table name, a field name, a field order or a field type changes
+template<typename T>
+uint64_t snapshot_schema_hash()
+{
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](std::string_view bytes) {
+        for (char c : bytes)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(reflection::get_name<T>());
+    reflection::for_each(T{}, [&mix](auto item, auto field, auto j) {
+        using U = std::remove_reference_t<decltype(std::declval<T&>().*item)>;
+        mix(field);
+        std::string type = std::to_string(sizeof(U)) + (std::is_floating_point_v<U> ? "f" :
+                           std::is_signed_v<U> ? "i" : std::is_same_v<U, std::string> ? "s" : "u");
+        mix(type);
+    });
+    return hash;
+}
+
+template<typename T>
+bool dump_snapshot(const std::string& path, const std::vector<T>& rows)
+{
+    constexpr std::size_t row_width = snapshot_row_width<T>();
+    std::vector<char> body(rows.size() * row_width);
+    std::string heap;
+    char* out = body.data();
+    for (auto& row : rows)
+    {
+        reflection::for_each(row, [&](auto item, auto field, auto j) {
+            using U = std::remove_const_t<std::remove_reference_t<decltype(row.*item)>>;
+            if constexpr (std::is_same_v<U, std::string>)
+            {
+                const std::string& value = row.*item;
+                uint64_t offset = heap.size();
+                uint32_t length = static_cast<uint32_t>(value.size());
+                heap += value;
+                memcpy(out, &offset, sizeof(offset));
+                memcpy(out + sizeof(offset), &length, sizeof(length));
+            }
+            else
+            {
+                memcpy(out, &(row.*item), sizeof(U));
+            }
+            out += snapshot_field_width<U>();
+        });
+    }
+
+    snapshot_header header{};
+    memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.row_width = static_cast<uint32_t>(row_width);
+    header.schema_hash = snapshot_schema_hash<T>();
+    header.row_count = rows.size();
+    header.rows_offset = sizeof(snapshot_header);
+    header.heap_offset = header.rows_offset + body.size();
+    header.heap_size = heap.size();
+
+    // write next to the target and rename, readers never see a half written file
+    std::string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.data(), "wb");
+    if (file == nullptr)
+    {
+        log_error("snapshot open failed:", tmp_path);
+        return false;
+    }
+    // the data must be on disk before the rename, or a crash can leave a short file under path
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(body.data(), 1, body.size(), file) == body.size() &&
+              fwrite(heap.data(), 1, heap.size(), file) == heap.size() &&
+              fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.data(), path.data()) != 0)
+    {
+        log_error("snapshot write failed:", path);
+        remove(tmp_path.data());
+        return false;
+    }
+    // and the rename itself survives a crash once the directory is synced
+    std::size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dir_fd = open(dir.data(), O_RDONLY);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
+
+template<typename T>
+bool dump_snapshot(pg_connection& conn, const std::string& path)
+{
+    auto query = conn.query<T>();
+    auto rows = query.to_vector();
+    return query.ok() && dump_snapshot(path, rows);
+}
+
+// read-only mapping of a snapshot file, rows are decoded on access
+template<typename T>
+class snapshot_file
+{
+public:
+    explicit snapshot_file(const std::string& path)
+    {
+        int fd = open(path.data(), O_RDONLY);
+        if (fd < 0)
+        {
+            log_error("snapshot open failed:", path);
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(snapshot_header))
+        {
+            size_ = st.st_size;
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            data_ = data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+        }
+        close(fd);
+        if (data_ == nullptr || !validate())
+        {
+            log_error("snapshot rejected:", path);
+            unmap();
+        }
+    }
+
+    snapshot_file(snapshot_file&& other) noexcept : data_(other.data_), size_(other.size_), header_(other.header_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    snapshot_file(const snapshot_file&) = delete;
+    snapshot_file& operator=(const snapshot_file&) = delete;
+
+    ~snapshot_file()
+    {
+        unmap();
+    }
+
+    bool ok() const
+    {
+        return data_ != nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return ok() ? header_.row_count : 0;
+    }
+
+    T operator[](std::size_t i) const
+    {
+        T row{};
+        const char* in = data_ + header_.rows_offset + i * header_.row_width;
+        const char* heap = data_ + header_.heap_offset;
+        reflection::for_each(row, [&](auto item, auto field, auto j) {
+            using U = std::remove_reference_t<decltype(row.*item)>;
+            if constexpr (std::is_same_v<U, std::string>)
+            {
+                uint64_t offset;
+                uint32_t length;
+                memcpy(&offset, in, sizeof(offset));
+                memcpy(&length, in + sizeof(offset), sizeof(length));
+                if (in_heap(offset, length))
+                    (row.*item).assign(heap + offset, length);
+            }
+            else
+            {
+                memcpy(&(row.*item), in, sizeof(U));
+            }
+            in += snapshot_field_width<U>();
+        });
+        return row;
+    }
+
+    std::vector<T> to_vector() const
+    {
+        std::vector<T> ret_vector;
+        ret_vector.reserve(size());
+        for (std::size_t i = 0; i < size(); i++)
+        {
+            ret_vector.push_back((*this)[i]);
+        }
+        return ret_vector;
+    }
+
+    // largest value of a monotonic column, the catch-up query asks for rows above it
+    template<typename U>
+    U high_water_mark(U T::* field) const
+    {
+        U mark{};
+        for (std::size_t i = 0; i < size(); i++)
+        {
+            U value = (*this)[i].*field;
+            if (i == 0 || mark < value)
+                mark = value;
+        }
+        return mark;
+    }
+
+private:
+    bool validate()
+    {
+        memcpy(&header_, data_, sizeof(header_));
+        if (memcmp(header_.magic, snapshot_magic, sizeof(header_.magic)) != 0 ||
+            header_.version != snapshot_version ||
+            header_.schema_hash != snapshot_schema_hash<T>() ||
+            header_.row_width != snapshot_row_width<T>())
+            return false;
+        if (header_.rows_offset < sizeof(snapshot_header) || header_.rows_offset > size_ ||
+            header_.row_count > (size_ - header_.rows_offset) / header_.row_width ||
+            header_.rows_offset + header_.row_count * header_.row_width != header_.heap_offset ||
+            header_.heap_size > size_ - header_.heap_offset)
+            return false;
+        return strings_in_heap();
+    }
+
+    bool in_heap(uint64_t offset, uint32_t length) const
+    {
+        return offset <= header_.heap_size && length <= header_.heap_size - offset;
+    }
+
+    // a truncated or corrupt file is rejected on load instead of read out of bounds
+    bool strings_in_heap() const
+    {
+        T probe{};
+        bool ok = true;
+        for (std::size_t i = 0; i < header_.row_count && ok; i++)
+        {
+            const char* in = data_ + header_.rows_offset + i * header_.row_width;
+            reflection::for_each(probe, [&](auto item, auto field, auto j) {
+                using U = std::remove_reference_t<decltype(probe.*item)>;
+                if constexpr (std::is_same_v<U, std::string>)
+                {
+                    uint64_t offset;
+                    uint32_t length;
+                    memcpy(&offset, in, sizeof(offset));
+                    memcpy(&length, in + sizeof(offset), sizeof(length));
+                    ok = ok && in_heap(offset, length);
+                }
+                in += snapshot_field_width<U>();
+            });
+        }
+        return ok;
+    }
+
+    void unmap()
+    {
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<char*>(data_), size_);
+            data_ = nullptr;
+        }
+    }
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    snapshot_header header_{};
+};
+
+template<typename T>
+snapshot_file<T> load_snapshot(const std::string& path)
+{
+    return snapshot_file<T>(path);
+}
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef PG_SUBSCRIPTION_HPP
+#define PG_SUBSCRIPTION_HPP
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <libpq-fe.h>
+#include "pg_log.hpp"
+
+namespace pg_ormlite
+{
+
+enum class change_op
+{
+    insert,
+    update,
+    del,
+    // the listener reconnected and may have missed notifications, reload everything
+    resync,
+};
+
+template<typename T>
+struct change_event
+{
+    change_op op;
+    // only the key field is filled in
+    T row;
+};
+
+// listens on one channel with a dedicated connection and hands every payload to
+// the handler on the listener thread. stops when destroyed.
+class subscription
+{
+public:
+    using handler = std::function<void(const char* payload)>;
+
+    subscription(const std::string& conninfo, const std::string& channel, handler on_payload, handler on_resync)
+    : conninfo_(conninfo), channel_(channel), on_payload_(std::move(on_payload)), on_resync_(std::move(on_resync))
+    {
+        conn_ = PQconnectdb(conninfo_.data());
+        if (!listen())
+        {
+            log_error(PQerrorMessage(conn_));
+        }
+        worker_ = std::thread([this] { run(); });
+    }
+
+    subscription(const subscription&) = delete;
+    subscription& operator=(const subscription&) = delete;
+
+    ~subscription()
+    {
+        stopping_ = true;
+        if (worker_.joinable())
+            worker_.join();
+        if (conn_ != nullptr)
+        {
+            PQfinish(conn_);
+            conn_ = nullptr;
+        }
+    }
+
+    const std::string& channel() const
+    {
+        return channel_;
+    }
+
+private:
+    bool listen()
+    {
+        if (PQstatus(conn_) != CONNECTION_OK)
+            return false;
+        std::string sql = "listen " + channel_ + ";";
+        PGresult* res = PQexec(conn_, sql.data());
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        return ok;
+    }
+
+    void run()
+    {
+        while (!stopping_)
+        {
+            if (PQstatus(conn_) != CONNECTION_OK)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                PQreset(conn_);
+                if (listen() && on_resync_)
+                    on_resync_("");
+                continue;
+            }
+
+            pollfd fd{PQsocket(conn_), POLLIN, 0};
+            if (poll(&fd, 1, 100) <= 0)
+                continue;
+            if (!PQconsumeInput(conn_))
+            {
+                log_error(PQerrorMessage(conn_));
+                continue;
+            }
+            PGnotify* notify = nullptr;
+            while ((notify = PQnotifies(conn_)) != nullptr)
+            {
+                on_payload_(notify->extra);
+                PQfreemem(notify);
+            }
+        }
+    }
+
+    std::string conninfo_;
+    std::string channel_;
+    handler on_payload_;
+    handler on_resync_;
+    PGconn* conn_ = nullptr;
+    std::atomic<bool> stopping_{false};
+    std::thread worker_;
+};
+
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef PG_WARMUP_HPP
+#define PG_WARMUP_HPP
+#include <functional>
+#include <string>
+#include <vector>
+#include "pg_ormlite.hpp"
+
+namespace pg_ormlite
+{
+
+// one statement to prepare: its text and the types its parameters are bound with
+struct statement_shape
+{
+    std::string sql;
+    std::vector<Oid> types;
+};
+
+// the statements a service runs, collected at startup and prepared on every new
+// connection before it serves a request. apply() sends all prepares and the warm-up
+// queries in one pipeline, so a connection is ready after a single round trip.
+class warmup_registry
+{
+public:
+    // the insert and update_row statements of T, and selects and deletes by a list of
+    // keys as get_by_keys and del().where(FD(key).in(keys)) run them. the key is the
+    // first field unless given.
+    template<typename T>
+    warmup_registry& add(const key_map& key = {})
+    {
+        generators_.push_back([key](pg_connection& conn, std::vector<statement_shape>& shapes) {
+            std::vector<Oid> row_types;
+            append_param_types<T>(row_types);
+            shapes.push_back({conn.generate_insert_sql<T>(false), row_types});
+            shapes.push_back({conn.generate_update_sql<T>(key), row_types});
+
+            std::string field = key.fields.empty() ? std::string(reflection::get_array<T>()[0]) : key.fields;
+            Oid key_type = 0;
+            for (auto& column : codec_table<T>())
+            {
+                if (column.name == field)
+                    key_type = array_type(column.oid);
+            }
+            if (key_type == 0)
+            {
+                log_error("warmup: no array type for key ", field, " of ", reflection::get_name<T>());
+                return;
+            }
+            // the statement text does not depend on the keys
+            auto by_keys = pg_query_object::expr(field, reflection::get_name<T>()).in(std::vector<int64_t>{});
+            shapes.push_back({conn.query<T>().where(by_keys).to_string(), {key_type}});
+            shapes.push_back({conn.del<T>().where(by_keys).to_string(), {key_type}});
+        });
+        return *this;
+    }
+
+    // a query shape, built the way requests build it: make(conn) returns a query_object.
+    // values that are bound as parameters, such as in() lists, time points and jsonb,
+    // may differ at run time, literal values must be the same to match.
+    template<typename F>
+    warmup_registry& add_query(F&& make)
+    {
+        generators_.push_back([make = std::forward<F>(make)](pg_connection& conn, std::vector<statement_shape>& shapes) {
+            auto query = make(conn);
+            statement_shape shape{query.to_string(), {}};
+            for (auto& param : query.params())
+            {
+                shape.types.push_back(param.type);
+            }
+            shapes.push_back(std::move(shape));
+        });
+        return *this;
+    }
+
+    // a statement run after the prepares whose rows are discarded, to load the catalog
+    // and the buffer cache, e.g. "select * from person limit 1;"
+    warmup_registry& add_warmup(std::string sql)
+    {
+        warmups_.push_back(std::move(sql));
+        return *this;
+    }
+
+    // prepares what the connection does not have yet, false when any statement failed
+    bool apply(pg_connection& conn) const
+    {
+        if (!conn.connected())
+            return false;
+        std::vector<statement_shape> shapes;
+        for (auto& generate : generators_)
+        {
+            generate(conn, shapes);
+        }
+        std::vector<statement_shape> pending;
+        for (auto& shape : shapes)
+        {
+            if (conn.prepared().find(shape.sql, shape.types) == nullptr)
+                pending.push_back(std::move(shape));
+        }
+        log_trace("warmup: prepare ", pending.size(), ", warm ", warmups_.size());
+        PGconn* pg = conn.native_handle();
+        bool ok = true;
+#ifdef LIBPQ_HAS_PIPELINING
+        if (!PQenterPipelineMode(pg))
+        {
+            log_error(PQerrorMessage(pg));
+            return false;
+        }
+        std::size_t sent = 0;
+        for (auto& shape : pending)
+        {
+            if (!PQsendPrepare(pg, prepared_statements::name_for(shape.sql, shape.types).data(), shape.sql.data(),
+                               (int)shape.types.size(), shape.types.data()))
+                break;
+            sent++;
+        }
+        std::size_t warmed = 0;
+        for (auto& sql : warmups_)
+        {
+            if (sent < pending.size() || !PQsendQueryParams(pg, sql.data(), 0, nullptr, nullptr, nullptr, nullptr, 1))
+                break;
+            warmed++;
+        }
+        ok = sent == pending.size() && warmed == warmups_.size();
+        if (!ok)
+            log_error(PQerrorMessage(pg));
+        if (PQpipelineSync(pg))
+        {
+            for (std::size_t i = 0; i < sent + warmed; i++)
+            {
+                PGresult* res = PQgetResult(pg);
+                ok = finish(conn, res, i < sent ? &pending[i] : nullptr) && ok;
+                // the null that ends the results of this statement
+                while (PGresult* extra = PQgetResult(pg))
+                {
+                    PQclear(extra);
+                }
+            }
+            PGresult* sync = PQgetResult(pg);
+            PQclear(sync);
+        }
+        PQexitPipelineMode(pg);
+#else
+        for (auto& shape : pending)
+        {
+            PGresult* res = PQprepare(pg, prepared_statements::name_for(shape.sql, shape.types).data(), shape.sql.data(),
+                                      (int)shape.types.size(), shape.types.data());
+            ok = finish(conn, res, &shape) && ok;
+        }
+        for (auto& sql : warmups_)
+        {
+            ok = finish(conn, PQexecParams(pg, sql.data(), 0, nullptr, nullptr, nullptr, nullptr, 1), nullptr) && ok;
+        }
+#endif
+        return ok;
+    }
+
+private:
+    // a prepared shape is remembered by the connection, a warm-up only checked
+    static bool finish(pg_connection& conn, PGresult* res, const statement_shape* shape)
+    {
+        auto status = PQresultStatus(res);
+        bool ok = status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+        if (!ok)
+            log_error("warmup:", PQresultErrorMessage(res));
+        else if (shape != nullptr)
+            conn.prepared().add(shape->sql, shape->types, prepared_statements::name_for(shape->sql, shape->types));
+        PQclear(res);
+        return ok;
+    }
+
+    std::vector<std::function<void(pg_connection&, std::vector<statement_shape>&)>> generators_;
+    std::vector<std::string> warmups_;
+};
+
+}
+
+#endif
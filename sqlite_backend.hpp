@@ -0,0 +1,431 @@
+#ifndef SQLITE_BACKEND_HPP
+#define SQLITE_BACKEND_HPP
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sqlite3.h>
+#include "pg_codec.hpp"
+#include "pg_cancel.hpp"
+
+namespace sqlite_ormlite
+{
+
+// embedded backend for pg_query_object::query_object, columns and parameters
+// are exchanged in native sqlite types instead of text
+struct sqlite_backend
+{
+    using connection_type = sqlite3;
+
+    class cursor
+    {
+    public:
+        // the statement has been reset and bound, the first row is fetched here.
+        // with a reason the statement is not run and the cursor fails with it.
+        cursor(sqlite3* db, sqlite3_stmt* stmt, const char* reason = nullptr) : db_(db), stmt_(stmt)
+        {
+            rc_ = stmt_ == nullptr || reason != nullptr ? SQLITE_ERROR : sqlite3_step(stmt_);
+            error_ = rc_ == SQLITE_ROW || rc_ == SQLITE_DONE ? "" : (reason != nullptr ? reason : sqlite3_errmsg(db_));
+            affected_ = rc_ == SQLITE_DONE ? sqlite3_changes(db_) : 0;
+        }
+
+        bool ok() const
+        {
+            return rc_ == SQLITE_ROW || rc_ == SQLITE_DONE;
+        }
+
+        std::string error() const
+        {
+            return error_;
+        }
+
+        long affected() const
+        {
+            return rows_ > 0 ? rows_ : affected_;
+        }
+
+        bool next()
+        {
+            if (!first_ && rc_ == SQLITE_ROW)
+            {
+                rc_ = sqlite3_step(stmt_);
+                if (!ok())
+                    error_ = sqlite3_errmsg(db_);
+            }
+            first_ = false;
+            if (rc_ != SQLITE_ROW)
+                return false;
+            rows_++;
+            return true;
+        }
+
+        int columns() const
+        {
+            return sqlite3_column_count(stmt_);
+        }
+
+        bool is_null(int col) const
+        {
+            return sqlite3_column_type(stmt_, col) == SQLITE_NULL;
+        }
+
+        // decoded by the codec table like postgres binary results, see column()
+        template<typename U>
+        void get(int col, U&& value) const
+        {
+            using V = std::remove_const_t<std::remove_reference_t<U>>;
+            pg_ormlite::codec<V>::decode_column(value, column(col, pg_ormlite::codec<V>::oid()));
+        }
+
+        template<typename T>
+        void get_row(T& row, int first = 0) const
+        {
+            pg_ormlite::decode_row(row, [this, first](int col, Oid type) {
+                return column(first + col, type);
+            });
+        }
+
+        // bytes decoded from the rows fetched so far
+        std::size_t bytes() const
+        {
+            return bytes_;
+        }
+
+    private:
+        // a column as the postgres binary value of its storage class: integers as int8, or
+        // as the date or timestamp a field of type stores, reals as float8, text and blobs
+        // as their bytes. it stays valid until the next call.
+        pg_ormlite::column_value column(int col, Oid type) const
+        {
+            switch (sqlite3_column_type(stmt_, col))
+            {
+                case SQLITE_NULL:
+                    return pg_ormlite::column_value{nullptr, 0, type, false};
+                case SQLITE_INTEGER:
+                {
+                    bool time = type == 1082 || type == 1184;
+                    int width = type == 1082 ? 4 : 8;
+                    store(static_cast<std::uint64_t>(sqlite3_column_int64(stmt_, col)), width);
+                    return pg_ormlite::column_value{number_, width, time ? type : 20, true};
+                }
+                case SQLITE_FLOAT:
+                {
+                    double value = sqlite3_column_double(stmt_, col);
+                    std::uint64_t bits;
+                    memcpy(&bits, &value, sizeof(bits));
+                    store(bits, 8);
+                    return pg_ormlite::column_value{number_, 8, 701, true};
+                }
+                case SQLITE_BLOB:
+                {
+                    auto blob = static_cast<const char*>(sqlite3_column_blob(stmt_, col));
+                    int size = sqlite3_column_bytes(stmt_, col);
+                    bytes_ += size;
+                    return pg_ormlite::column_value{blob == nullptr ? "" : blob, size, 17, true};
+                }
+                default:
+                {
+                    auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt_, col));
+                    int size = sqlite3_column_bytes(stmt_, col);
+                    bytes_ += size;
+                    return pg_ormlite::column_value{text == nullptr ? "" : text, size, 25, true};
+                }
+            }
+        }
+
+        void store(std::uint64_t value, int width) const
+        {
+            for (int i = width - 1; i >= 0; i--, value >>= 8)
+            {
+                number_[i] = static_cast<char>(value & 0xff);
+            }
+            bytes_ += width;
+        }
+
+        sqlite3* db_;
+        sqlite3_stmt* stmt_;
+        int rc_ = SQLITE_ERROR;
+        bool first_ = true;
+        long rows_ = 0;
+        long affected_ = 0;
+        std::string error_;
+        mutable std::size_t bytes_ = 0;
+        mutable char number_[8] = {};
+    };
+
+    class statement
+    {
+    public:
+        statement(sqlite3* db, const std::string& sql) : db_(db)
+        {
+            if (sqlite3_prepare_v2(db_, sql.data(), (int)sql.size(), &stmt_, nullptr) != SQLITE_OK)
+            {
+                pg_ormlite::log_error(sqlite3_errmsg(db_));
+                stmt_ = nullptr;
+            }
+        }
+
+        statement(const statement&) = delete;
+        statement& operator=(const statement&) = delete;
+
+        ~statement()
+        {
+            release_limits();
+            if (stmt_ != nullptr)
+                sqlite3_finalize(stmt_);
+        }
+
+        bool ok() const
+        {
+            return stmt_ != nullptr;
+        }
+
+        // encoded by the codec table like a postgres parameter, see bind_param
+        template<typename U>
+        void bind(int index, U&& value)
+        {
+            using V = std::remove_const_t<std::remove_reference_t<U>>;
+            bind_param(index, pg_ormlite::value_param<V>(value));
+        }
+
+        // text parameters bind as text, or as numbers when they carry a numeric type as
+        // the fields of an insert do. binary dates and timestamps bind as the day or
+        // microsecond count postgres stores, jsonb as its text and bytea as a blob.
+        // sqlite has no array type. rebinding after step() starts the next execution.
+        void bind_param(int index, const pg_ormlite::param_value& param)
+        {
+            if (stmt_ == nullptr)
+                return;
+            if (stepped_)
+            {
+                sqlite3_reset(stmt_);
+                stepped_ = false;
+            }
+            int size = (int)param.data.size();
+            if (param.null)
+                sqlite3_bind_null(stmt_, index);
+            else if (param.format == 0)
+            {
+                if (param.data.empty())
+                    sqlite3_bind_null(stmt_, index);
+                else if (pg_ormlite::is_integer_type(param.type))
+                    sqlite3_bind_int64(stmt_, index, strtoll(param.data.data(), nullptr, 10));
+                else if (pg_ormlite::is_float_type(param.type))
+                    sqlite3_bind_double(stmt_, index, strtod(param.data.data(), nullptr));
+                else
+                    sqlite3_bind_text(stmt_, index, param.data.data(), size - 1, SQLITE_TRANSIENT);
+            }
+            else if ((param.type == 1082 && size == 4) || (param.type == 1184 && size == 8))
+            {
+                auto count = pg_ormlite::read_big_endian(param.data.data(), size);
+                sqlite3_bind_int64(stmt_, index, size == 4 ? (int32_t)count : (int64_t)count);
+            }
+            else if (param.type == 3802 && size > 0)
+                sqlite3_bind_text(stmt_, index, param.data.data() + 1, size - 1, SQLITE_TRANSIENT);
+            else if (param.type == 17)
+                sqlite3_bind_blob(stmt_, index, size == 0 ? "" : param.data.data(), size, SQLITE_TRANSIENT);
+            else
+            {
+                pg_ormlite::log_error("binary parameters are not supported by sqlite");
+                sqlite3_bind_null(stmt_, index);
+            }
+        }
+
+        // sqlite statements are prepared when they are created
+        void prepared(const std::string&)
+        {
+
+        }
+
+        // the limits stay armed while the cursor fetches rows, until the statement is destroyed
+        cursor step(const pg_ormlite::exec_options& options = {})
+        {
+            if (stmt_ != nullptr)
+                sqlite3_reset(stmt_);
+            stepped_ = true;
+            release_limits();
+            // sqlite3_interrupt only reaches statements that are already running
+            if (options.token != nullptr && options.token->cancelled())
+                return cursor(db_, stmt_, "interrupted");
+            if (options.limited())
+            {
+                options_ = options;
+                deadline_ = std::chrono::steady_clock::now() + options.timeout;
+                sqlite3_progress_handler(db_, 1000, &statement::progress, this);
+                if (options_.token != nullptr)
+                    options_.token->attach([db = db_]() { sqlite3_interrupt(db); });
+            }
+            return cursor(db_, stmt_);
+        }
+
+    private:
+        static int progress(void* self)
+        {
+            auto stmt = static_cast<statement*>(self);
+            if (stmt->options_.token != nullptr && stmt->options_.token->cancelled())
+                return 1;
+            return stmt->options_.timeout.count() > 0 && std::chrono::steady_clock::now() > stmt->deadline_;
+        }
+
+        void release_limits()
+        {
+            if (!options_.limited())
+                return;
+            sqlite3_progress_handler(db_, 0, nullptr, nullptr);
+            if (options_.token != nullptr)
+                options_.token->detach();
+            options_ = {};
+        }
+
+        pg_ormlite::exec_options options_;
+        std::chrono::steady_clock::time_point deadline_;
+        sqlite3* db_;
+        sqlite3_stmt* stmt_ = nullptr;
+        bool stepped_ = false;
+    };
+
+    // sqlite has no array type: "= any($n)" and "<> all($n)" over an array parameter become
+    // "in (...)" and "not in (...)" with one parameter per element, and every placeholder
+    // is renumbered in text order
+    static std::string expand_arrays(const std::string& sql, std::vector<pg_ormlite::param_value>& params)
+    {
+        if (std::none_of(params.begin(), params.end(), is_array_param))
+            return sql;
+        std::vector<pg_ormlite::param_value> expanded;
+        std::string text;
+        text.reserve(sql.size() + 16);
+        char quote = 0;
+        for (std::size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (quote == 0 && c == '$' && i + 1 < sql.size() && isdigit((unsigned char)sql[i + 1]))
+            {
+                std::size_t n = 0;
+                while (i + 1 < sql.size() && isdigit((unsigned char)sql[i + 1]))
+                {
+                    n = n * 10 + (sql[++i] - '0');
+                }
+                if (n == 0 || n > params.size())
+                {
+                    text += "$" + std::to_string(n);
+                    continue;
+                }
+                auto& param = params[n - 1];
+                const char* op = ends_with(text, " = any(") ? " = any(" : (ends_with(text, " <> all(") ? " <> all(" : nullptr);
+                if (op == nullptr || !is_array_param(param) || i + 1 >= sql.size() || sql[i + 1] != ')')
+                {
+                    expanded.push_back(param);
+                    text += "$" + std::to_string(expanded.size());
+                    continue;
+                }
+                text.resize(text.size() - strlen(op));
+                text += op[1] == '=' ? " in (" : " not in (";
+                auto elements = array_elements(param);
+                for (std::size_t e = 0; e < elements.size(); e++)
+                {
+                    expanded.push_back(std::move(elements[e]));
+                    text += (e == 0 ? "$" : ", $") + std::to_string(expanded.size());
+                }
+                continue;
+            }
+            if (quote == 0 && (c == '\'' || c == '"'))
+                quote = c;
+            else if (c == quote)
+                quote = 0;
+            text += c;
+        }
+        params = std::move(expanded);
+        return text;
+    }
+
+    static std::string error_message(sqlite3* db)
+    {
+        return sqlite3_errmsg(db);
+    }
+
+private:
+    static bool is_array_param(const pg_ormlite::param_value& param)
+    {
+        return param.format == 1 && !param.null && param.data.size() >= 12 &&
+               pg_ormlite::array_type((Oid)pg_ormlite::read_big_endian(param.data.data() + 8, 4)) == param.type;
+    }
+
+    static bool ends_with(const std::string& text, const char* suffix)
+    {
+        std::size_t size = strlen(suffix);
+        return text.size() >= size && text.compare(text.size() - size, size, suffix) == 0;
+    }
+
+    // the elements of a one dimensional binary array as the parameters bind_param takes:
+    // numbers and strings as text, dates and timestamps in their binary form
+    static std::vector<pg_ormlite::param_value> array_elements(const pg_ormlite::param_value& param)
+    {
+        std::vector<pg_ormlite::param_value> elements;
+        const char* data = param.data.data();
+        std::size_t size = param.data.size();
+        int dims = (int)pg_ormlite::read_big_endian(data, 4);
+        Oid element = (Oid)pg_ormlite::read_big_endian(data + 8, 4);
+        if (dims != 1 || size < 20)
+            return elements;
+        std::size_t count = pg_ormlite::read_big_endian(data + 12, 4);
+        std::size_t pos = 20;
+        for (std::size_t e = 0; e < count && pos + 4 <= size; e++)
+        {
+            auto length = (int32_t)pg_ormlite::read_big_endian(data + pos, 4);
+            pos += 4;
+            pg_ormlite::param_value value;
+            if (length < 0 || pos + length > size)
+            {
+                value.null = true;
+                elements.push_back(std::move(value));
+                continue;
+            }
+            const char* bytes = data + pos;
+            pos += length;
+            std::string number;
+            if (pg_ormlite::is_integer_type(element))
+                number = std::to_string((int64_t)(length == 2 ? (int16_t)pg_ormlite::read_big_endian(bytes, 2) :
+                                                  length == 4 ? (int32_t)pg_ormlite::read_big_endian(bytes, 4) :
+                                                                (int64_t)pg_ormlite::read_big_endian(bytes, 8)));
+            else if (element == 700 || element == 701)
+            {
+                char buffer[32];
+                if (element == 700)
+                {
+                    float f;
+                    uint32_t bits = (uint32_t)pg_ormlite::read_big_endian(bytes, 4);
+                    memcpy(&f, &bits, sizeof(f));
+                    snprintf(buffer, sizeof(buffer), "%.9g", f);
+                }
+                else
+                {
+                    double d;
+                    uint64_t bits = pg_ormlite::read_big_endian(bytes, 8);
+                    memcpy(&d, &bits, sizeof(d));
+                    snprintf(buffer, sizeof(buffer), "%.17g", d);
+                }
+                number = buffer;
+            }
+            if (element == 1082 || element == 1184)
+            {
+                value.format = 1;
+                value.type = element;
+                value.data.assign(bytes, bytes + length);
+            }
+            else
+            {
+                if (number.empty())
+                    value.data.assign(bytes, bytes + length);
+                else
+                    value.data.assign(number.begin(), number.end());
+                value.data.push_back('\0');
+            }
+            elements.push_back(std::move(value));
+        }
+        return elements;
+    }
+};
+
+}
+
+#endif
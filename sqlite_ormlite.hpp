@@ -0,0 +1,247 @@
+#ifndef SQLITE_ORMLITE_HPP
+#define SQLITE_ORMLITE_HPP
+#include <iostream>
+#include <string>
+#include <vector>
+#include "reflection.hpp"
+#include "traits_utils.hpp"
+#include "pg_query_object.hpp"
+#include "pg_ormlite.hpp"
+#include "sqlite_backend.hpp"
+
+namespace sqlite_ormlite
+{
+
+using key_map = pg_ormlite::key_map;
+using auto_key_map = pg_ormlite::auto_key_map;
+using not_null_map = pg_ormlite::not_null_map;
+
+// embedded sqlite database behind the same reflected api as pg_connection,
+// for tests, tools and edge deployments without a postgres server
+class sqlite_connection
+{
+public:
+    template<typename T>
+    using query_type = pg_query_object::query_object<T, sqlite_backend>;
+
+    // a file path, or ":memory:" for a private in-memory database
+    explicit sqlite_connection(const std::string& path)
+    {
+        pg_ormlite::log_trace("open:", path);
+        if (sqlite3_open(path.data(), &db_) != SQLITE_OK)
+        {
+            pg_ormlite::log_error(sqlite3_errmsg(db_));
+            sqlite3_close(db_);
+            db_ = nullptr;
+        }
+    }
+
+    sqlite_connection(const sqlite_connection&) = delete;
+    sqlite_connection& operator=(const sqlite_connection&) = delete;
+
+    ~sqlite_connection()
+    {
+        if (db_ != nullptr)
+        {
+            pg_ormlite::log_trace("release sqlite conn");
+            sqlite3_close(db_);
+            db_ = nullptr;
+        }
+    }
+
+    bool connected() const
+    {
+        return db_ != nullptr;
+    }
+
+    bool execute(const std::string& sql)
+    {
+        char* err = nullptr;
+        if (sqlite3_exec(db_, sql.data(), nullptr, nullptr, &err) != SQLITE_OK)
+        {
+            pg_ormlite::log_error(err != nullptr ? err : sqlite3_errmsg(db_));
+            sqlite3_free(err);
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T, typename... Args>
+    bool create_table(Args&&... args)
+    {
+        std::string sql = generate_create_table_sql<T>(std::forward<Args>(args)...);
+        pg_ormlite::log_trace("create:", sql);
+        return execute(sql);
+    }
+
+    template<typename T>
+    int insert(T&& t)
+    {
+        using U = std::remove_const_t<std::remove_reference_t<T>>;
+        std::string sql = generate_insert_sql<U>();
+        pg_ormlite::log_trace("insert prepare:", sql);
+        sqlite_backend::statement stmt(db_, sql);
+        return stmt.ok() && insert_impl(stmt, t);
+    }
+
+    // one transaction and one prepared statement for the whole vector
+    template<typename T>
+    int insert(std::vector<T>& t)
+    {
+        std::string sql = generate_insert_sql<T>();
+        pg_ormlite::log_trace("insert prepare:", sql);
+        sqlite_backend::statement stmt(db_, sql);
+        if (!stmt.ok() || !execute("begin;"))
+            return 0;
+        for (auto& item : t)
+        {
+            if (!insert_impl(stmt, item))
+            {
+                execute("rollback;");
+                return 0;
+            }
+        }
+        if (!execute("commit;"))
+            return 0;
+        return t.size();
+    }
+
+    template<typename T>
+    constexpr typename std::enable_if<reflection::is_reflection<T>::value, query_type<T>>::type query()
+    {
+        return query_type<T>(db_, reflection::get_name<T>());
+    }
+
+    template<typename T>
+    constexpr typename std::enable_if<reflection::is_reflection<T>::value, query_type<T>>::type del()
+    {
+        return query_type<T>(db_, reflection::get_name<T>(), "delete", "");
+    }
+
+    template<typename T>
+    constexpr typename std::enable_if<reflection::is_reflection<T>::value, query_type<T>>::type update()
+    {
+        return query_type<T>(db_, reflection::get_name<T>(), "", "update");
+    }
+
+    std::string error_message() const
+    {
+        return sqlite_backend::error_message(db_);
+    }
+
+private:
+    // the fields are encoded by the codec table, which copies them out of packed structs
+    template<typename T>
+    bool insert_impl(sqlite_backend::statement& stmt, const T& t)
+    {
+        std::vector<pg_ormlite::param_value> params;
+        pg_ormlite::encode_row(t, params);
+        for (std::size_t i = 0; i < params.size(); i++)
+        {
+            stmt.bind_param((int)i + 1, params[i]);
+        }
+        auto cursor = stmt.step();
+        if (!cursor.ok())
+        {
+            pg_ormlite::log_error(cursor.error());
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    std::string generate_insert_sql()
+    {
+        std::string sql = "insert into ";
+        sql += reflection::get_name<T>().data();
+        sql += "(" + std::string(reflection::get_field<T>().data()) + ") values(";
+        constexpr auto field_size = reflection::get_value<T>();
+        for (size_t i = 0; i < field_size; i++)
+        {
+            sql += "?" + std::to_string(i + 1);
+            if (i != field_size - 1)
+                sql += ", ";
+        }
+        sql += ");";
+        return sql;
+    }
+
+    // sqlite storage class of a field, from the oid the codec table sends it with
+    static std::string type_name(const pg_ormlite::field_codec& field)
+    {
+        switch (field.oid)
+        {
+            case 21: case 23: case 20: case 1082: case 1184: return "integer";
+            case 700: case 701: return "real";
+            case 25: case 3802: return "text";
+            case 1043: return "varchar(" + std::to_string(field.size) + ")";
+            case 17: return "blob";
+            default: return "";
+        }
+    }
+
+    template <typename T>
+    auto get_type_names()
+    {
+        auto& table = pg_ormlite::codec_table<T>();
+        std::array<std::string, reflection::get_value<T>()> field_types;
+        for (std::size_t i = 0; i < table.size(); i++)
+        {
+            field_types[i] = type_name(table[i]);
+        }
+        return field_types;
+    }
+
+    // key_map, auto_key_map and not_null_map are understood, the postgres only
+    // index, partition and storage options are ignored
+    template<typename T, typename... Args>
+    std::string generate_create_table_sql(Args&&... args)
+    {
+        const key_map* key = nullptr;
+        const auto_key_map* auto_key = nullptr;
+        const not_null_map* not_null = nullptr;
+        auto options = std::forward_as_tuple(args...);
+        reflection::for_each(options, [&](auto& item, auto j){
+            using U = std::decay_t<decltype(item)>;
+            if constexpr (std::is_same_v<U, key_map>)
+                key = &item;
+            else if constexpr (std::is_same_v<U, auto_key_map>)
+                auto_key = &item;
+            else if constexpr (std::is_same_v<U, not_null_map>)
+                not_null = &item;
+        });
+        static_assert(!(traits_utils::has_type<key_map, std::tuple<std::decay_t<Args>...>>::value &&
+                        traits_utils::has_type<auto_key_map, std::tuple<std::decay_t<Args>...>>::value),
+                      "key_map and auto_key_map cannot be used together");
+
+        std::string sql = std::string("create table if not exists ") + reflection::get_name<T>().data() + "(";
+        auto field_names = reflection::get_array<T>();
+        auto field_types = get_type_names<T>();
+        bool composite = key != nullptr && key->fields.find(',') != std::string::npos;
+        for (size_t i = 0; i < field_names.size(); i++)
+        {
+            std::string field_name = field_names[i].data();
+            sql += field_name + " ";
+            if (auto_key != nullptr && auto_key->fields == field_name)
+                sql += "integer primary key autoincrement";
+            else
+                sql += field_types[i];
+            if (key != nullptr && !composite && key->fields == field_name)
+                sql += " primary key";
+            if (not_null != nullptr && not_null->fields.count(field_name) > 0)
+                sql += " not null";
+            if (i != field_names.size() - 1)
+                sql += ", ";
+        }
+        if (composite)
+            sql += ", primary key (" + key->fields + ")";
+        sql += ");";
+        return sql;
+    }
+
+    sqlite3* db_ = nullptr;
+};
+
+}
+
+#endif
@@ -32,7 +32,12 @@ struct array_size<char[N]>
     static constexpr std::size_t value = N;
 };
 
+template<typename T>
+struct is_tuple : std::false_type {};
+
+template<typename... Args>
+struct is_tuple<std::tuple<Args...>> : std::true_type {};
 
 }
 
-#endif
\ No newline at end of file
+#endif